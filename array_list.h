@@ -29,47 +29,220 @@
 #ifndef STRUCTURES_ARRAY_LIST_H
 #define STRUCTURES_ARRAY_LIST_H
 
+#include <algorithm>
+#include <functional>
 #include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <utility>
 #include <stdexcept>  // C++ exceptions
+#include <type_traits>
+#include <sys/mman.h>
 
 namespace structures {
 
-/** An implementation of a vector List.
+/** The default allocator: malloc, and realloc to grow, which moves big blocks
+ * by remapping their pages instead of copying them.
+     */
+template <typename T>
+struct MallocAllocator {
+  typedef T value_type;
+
+  MallocAllocator() = default;
+  template <typename U>
+  MallocAllocator(const MallocAllocator<U>&) {}
+
+  T* allocate(std::size_t n) {
+    void* p = std::malloc(n * sizeof(T));
+    if (!p) {
+      throw std::bad_alloc();
+    }
+    return static_cast<T*>(p);
+  }
+  /** returns nullptr, and leaves the block as it was, when it fails
+       */
+  T* reallocate(T* p, std::size_t, std::size_t n) {
+    return static_cast<T*>(std::realloc(p, n * sizeof(T)));
+  }
+  void deallocate(T* p, std::size_t) { std::free(p); }
+
+  template <typename U>
+  bool operator==(const MallocAllocator<U>&) const { return true; }
+  template <typename U>
+  bool operator!=(const MallocAllocator<U>&) const { return false; }
+};
+
+/** An allocator for big lists: blocks of 2 MiB or more are aligned to 2 MiB
+ * and the kernel is asked to back them with huge pages.
      */
 template <typename T>
+struct HugePageAllocator {
+  typedef T value_type;
+  static const std::size_t HUGE_PAGE = 2u << 20;
+
+  HugePageAllocator() = default;
+  template <typename U>
+  HugePageAllocator(const HugePageAllocator<U>&) {}
+
+  T* allocate(std::size_t n) {
+    std::size_t bytes = n * sizeof(T);
+    void* p = nullptr;
+    if (bytes < HUGE_PAGE) {
+      p = std::malloc(bytes);
+    } else if (posix_memalign(&p, HUGE_PAGE, bytes)) {
+      p = nullptr;
+    } else {
+      madvise(p, bytes, MADV_HUGEPAGE);
+    }
+    if (!p) {
+      throw std::bad_alloc();
+    }
+    return static_cast<T*>(p);
+  }
+  void deallocate(T* p, std::size_t) { std::free(p); }
+
+  template <typename U>
+  bool operator==(const HugePageAllocator<U>&) const { return true; }
+  template <typename U>
+  bool operator!=(const HugePageAllocator<U>&) const { return false; }
+};
+
+/** An implementation of a vector List.
+ *
+ * It doubles its capacity when it is full, and gets its memory from
+ * Allocator. Elements that are trivially copyable grow in place when the
+ * allocator has reallocate(p, old_n, new_n).
+     */
+template <typename T, typename Allocator = MallocAllocator<T>>
 class ArrayList {
+  typedef std::allocator_traits<Allocator> traits;
+
+  template <typename A>
+  static auto has_reallocate(A* a) -> decltype(a->reallocate((T*)0, 0, 0), std::true_type());
+  static std::false_type has_reallocate(...);
+  static const bool REALLOCATE = std::is_trivially_copyable<T>::value &&
+                                 decltype(has_reallocate((Allocator*)0))::value;
+
  public:
   /** Initializes with default size
       */
-  ArrayList() {
-    max_size_ = 10;
-    size_ = 0;
-    contents = new T[10];
-  }
-  /** Initializes an empty list with the supplied maximum size.
+  ArrayList() : ArrayList(DEFAULT_MAX) {}
+  /** Initializes an empty list with room for the supplied number of elements.
      */
-  explicit ArrayList(std::size_t max_size) {
-    max_size_ = max_size;
-    size_ = 0;
-    contents = new T[max_size_];
+  explicit ArrayList(std::size_t max_size, const Allocator& allocator = Allocator())
+      : allocator_(allocator), contents(nullptr), size_(0), max_size_(0) {
+    reserve(max_size);
+  }
+
+  ArrayList(const ArrayList& other)
+      : allocator_(traits::select_on_container_copy_construction(other.allocator_)),
+        contents(nullptr), size_(0), max_size_(0) {
+    append(other.contents, other.size_);
   }
 
-  ~ArrayList() { delete[] contents; }
+  ArrayList(ArrayList&& other) noexcept
+      : allocator_(std::move(other.allocator_)), contents(other.contents),
+        size_(other.size_), max_size_(other.max_size_) {
+    other.contents = nullptr;
+    other.size_ = other.max_size_ = 0;
+  }
+
+  ArrayList& operator=(const ArrayList& other) {
+    if (this != &other) {
+      ArrayList copy(other);
+      swap(copy);
+    }
+    return *this;
+  }
+
+  ArrayList& operator=(ArrayList&& other) noexcept {
+    if (this != &other) {
+      release();
+      allocator_ = std::move(other.allocator_);
+      contents = other.contents;
+      size_ = other.size_;
+      max_size_ = other.max_size_;
+      other.contents = nullptr;
+      other.size_ = other.max_size_ = 0;
+    }
+    return *this;
+  }
+
+  ~ArrayList() { release(); }
+
+  void swap(ArrayList& other) noexcept {
+    std::swap(allocator_, other.allocator_);
+    std::swap(contents, other.contents);
+    std::swap(size_, other.size_);
+    std::swap(max_size_, other.max_size_);
+  }
 
   /** removes all elements from the list.
    */
-  inline void clear() { size_ = 0; }
+  inline void clear() {
+    destroy(0, size_);
+    size_ = 0;
+  }
+
+  /** makes room for at least the given number of elements
+   */
+  void reserve(std::size_t max_size) {
+    if (max_size > max_size_) {
+      reallocate(max_size);
+    }
+  }
 
   /** inserts a element at the last position of the list
      */
   void push_back(const T& data) {
-    //if (full()) {
-    //  throw std::out_of_range("list is full");
-    //}
-    contents[size_] = data;
+    if (full()) {
+      grow_back(data);
+      return;
+    }
+    traits::construct(allocator_, contents + size_, data);
+    size_++;
+  }
+
+  void push_back(T&& data) {
+    if (full()) {
+      grow_back(std::move(data));
+      return;
+    }
+    traits::construct(allocator_, contents + size_, std::move(data));
     size_++;
   }
 
+  /** builds an element in place at the last position of the list
+     */
+  template <typename... Args>
+  T& emplace_back(Args&&... args) {
+    if (full()) {
+      grow_back(std::forward<Args>(args)...);
+    } else {
+      traits::construct(allocator_, contents + size_, std::forward<Args>(args)...);
+      size_++;
+    }
+    return contents[size_ - 1];
+  }
+
+  /** copies n elements to the end of the list, growing it once at most;
+   * they may come from the list itself
+     */
+  void append(const T* data, std::size_t n) {
+    if (size_ + n > max_size_) {
+      std::less<const T*> before;
+      bool inside = !before(data, contents) && before(data, contents + size_);
+      std::size_t offset = inside ? data - contents : 0;
+      reallocate(std::max(size_ + n, 2 * max_size_));
+      if (inside) {
+        data = contents + offset;
+      }
+    }
+    std::uninitialized_copy(data, data + n, contents + size_);
+    size_ += n;
+  }
+
   /** inserts an element at the first position of the list
        */
   void push_front(const T& data) { insert(data, 0); }
@@ -77,17 +250,19 @@ class ArrayList {
   /** inserts an element at the given index.
        */
   void insert(const T& data, std::size_t index) {
-    if (full()) {
-      throw std::out_of_range("list is full");
-    }
     if (index > size_) {
       throw std::out_of_range("invalid index");
     }
-    for (int i = size_; i > index; --i) {
-      contents[i] = contents[i - 1];
+    if (index == size_) {
+      push_back(data);
+      return;
     }
-    contents[index] = data;
-    size_++;
+    T copy(data);
+    push_back(std::move(contents[size_ - 1]));
+    for (std::size_t i = size_ - 2; i > index; --i) {
+      contents[i] = std::move(contents[i - 1]);
+    }
+    contents[index] = std::move(copy);
   }
 
   /** inserts an element in before the first element on the list that is greater
@@ -95,7 +270,7 @@ class ArrayList {
    * This method assumes the list is sorted.
           */
   void insert_sorted(const T& data) {
-    for (int i = 0; i < size_; ++i) {
+    for (std::size_t i = 0; i < size_; ++i) {
       if (contents[i] > data) {
         insert(data, i);
         return;
@@ -110,11 +285,12 @@ class ArrayList {
     if (index >= size_) {
       throw std::out_of_range("invalid index");
     }
-    auto data = contents[index];
-    for (int i = index; i < size_-1; ++i) {
-      contents[i] = contents[i + 1];
+    T data = std::move(contents[index]);
+    for (std::size_t i = index; i < size_-1; ++i) {
+      contents[i] = std::move(contents[i + 1]);
     }
     size_--;
+    destroy(size_, size_ + 1);
     return data;
   }
 
@@ -124,8 +300,10 @@ class ArrayList {
     if (empty()) {
       throw std::out_of_range("invalid index");
     }
+    T data = std::move(contents[size_ - 1]);
     size_--;
-    return contents[size_];
+    destroy(size_, size_ + 1);
+    return data;
   }
 
   /** removes the first element
@@ -135,14 +313,14 @@ class ArrayList {
   /** removes the first appearance of the given element
        */
   void remove(const T& data) {
-    for (int i = 0; i < size_; ++i) {
+    for (std::size_t i = 0; i < size_; ++i) {
       if (contents[i] == data) {
         pop(i);
       }
     }
   }
 
-  /** self-explanatory
+  /** true when the next insertion has to grow the list
        */
   bool full() const { return size_ == max_size_; }
 
@@ -153,7 +331,7 @@ class ArrayList {
   /** returns true if the given element appears on the list
        */
   bool contains(const T& data) const {
-    for (int i = 0; i < size_; ++i) {
+    for (std::size_t i = 0; i < size_; ++i) {
       if (contents[i] == data) {
         return true;
       }
@@ -164,7 +342,7 @@ class ArrayList {
   /** returns the index of the first appearance of the element in the list
        */
   std::size_t find(const T& data) const {
-    for (int i = 0; i < size_; ++i) {
+    for (std::size_t i = 0; i < size_; ++i) {
       if (contents[i] == data) {
         return i;
       }
@@ -174,9 +352,10 @@ class ArrayList {
   /** returns the current size of the list
        */
   std::size_t size() const { return size_; }
-  /** returns the maximum size of the list
+  /** returns how many elements fit before the list grows
        */
   std::size_t max_size() const { return max_size_; }
+  std::size_t capacity() const { return max_size_; }
   /** returns the element at the given index
        */
   inline T& at(std::size_t index) {
@@ -210,12 +389,85 @@ class ArrayList {
     return contents[index];
   }
 
+  T* data() { return contents; }
+  const T* data() const { return contents; }
+  T* begin() { return contents; }
+  T* end() { return contents + size_; }
+  const T* begin() const { return contents; }
+  const T* end() const { return contents + size_; }
+
  private:
+  /** the slow path of push_back and emplace_back: the new element is built
+   * before the old ones move, since it may be made from one of them
+       */
+  template <typename... Args>
+  void grow_back(Args&&... args) {
+    std::size_t max_size = max_size_ ? 2 * max_size_ : DEFAULT_MAX;
+    if (REALLOCATE) {
+      T data(std::forward<Args>(args)...);
+      reallocate(max_size);
+      traits::construct(allocator_, contents + size_, std::move(data));
+    } else {
+      T* grown = traits::allocate(allocator_, max_size);
+      traits::construct(allocator_, grown + size_, std::forward<Args>(args)...);
+      move_to(grown, max_size);
+    }
+    size_++;
+  }
+
+  void reallocate(std::size_t max_size) {
+    T* grown = contents ? resize(max_size, std::integral_constant<bool, REALLOCATE>()) : nullptr;
+    if (grown) {
+      contents = grown;
+      max_size_ = max_size;
+      return;
+    }
+    move_to(traits::allocate(allocator_, max_size), max_size);
+  }
+
+  /** grows the block in place; only instantiated when REALLOCATE holds,
+   * so realloc never sees an element that is not trivially copyable
+       */
+  T* resize(std::size_t max_size, std::true_type) {
+    return allocator_.reallocate(contents, max_size_, max_size);
+  }
+  T* resize(std::size_t, std::false_type) { return nullptr; }
+
+  /** moves the elements to a new block and frees the old one
+       */
+  void move_to(T* grown, std::size_t max_size) {
+    for (std::size_t i = 0; i < size_; ++i) {
+      traits::construct(allocator_, grown + i, std::move(contents[i]));
+    }
+    destroy(0, size_);
+    if (contents) {
+      traits::deallocate(allocator_, contents, max_size_);
+    }
+    contents = grown;
+    max_size_ = max_size;
+  }
+
+  void destroy(std::size_t from, std::size_t to) {
+    for (std::size_t i = from; i < to; ++i) {
+      traits::destroy(allocator_, contents + i);
+    }
+  }
+
+  void release() {
+    destroy(0, size_);
+    if (contents) {
+      traits::deallocate(allocator_, contents, max_size_);
+    }
+    contents = nullptr;
+    size_ = max_size_ = 0;
+  }
+
+  Allocator allocator_;
   T* contents;
   std::size_t size_;
   std::size_t max_size_;
 
-  static const auto DEFAULT_MAX = 10u;
+  static const std::size_t DEFAULT_MAX = 10u;
 };
 }  // namespace structures
 
@@ -0,0 +1,385 @@
+/*
+* Benchmark driver for the Game of Life engines.
+*
+* For every board size and density it writes a random board (generator.h, so
+* a seed always gives the same board), runs every engine on it for every
+* thread count, and checks that all of them print the same final board. Only
+* when every run agrees it reports generations and cells per second, cycles
+* per cell and peak RSS of each run, as CSV or JSON.
+*
+* The time an engine spends reading and printing the board is measured by a
+* run of zero generations and left out of the rates. Cycles come from the
+* cpu-cycles perf counter when it can be opened, and are estimated from the
+* cpu time and the TSC frequency otherwise (the counter column says which).
+* HashLife and the sparse change list play on an unbounded plane, so while
+* they are selected the random cells are kept as many cells away from the
+* edge as there are generations, and every engine must agree.
+*
+* Run it from the top of the repository, after make.
+*
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <x86intrin.h>
+#include "generator.h"
+
+typedef struct {
+  const char * name;
+  const char * command;  /* %d is the number of threads, or of processes for t2, whose
+                          * commands take the mpirun command line and it up to twice */
+  int threaded;
+  int unbounded;
+  int mpi;               /* the command starts with the mpirun command line */
+} engine_t;
+
+static const engine_t engines[] = {
+  {"bitboard",    "trabalho/bitboard",              0, 0, 0},
+  {"sequencial",  "trabalho/sequencial",            0, 0, 0},
+  {"gol",         "trabalho/gol %d",                1, 0, 0},
+  {"t2",          "%s -np %d trabalho2/t2exe",      1, 0, 1},
+  {"t2-2d",       "%s -np %d trabalho2/t2exe 2d",   1, 0, 1},
+  {"t2-threads",  "%s -np 1 trabalho2/t2exe -t %d", 1, 0, 1},
+  /* converts the board to binary and plays it from there */
+  {"t2-binary",   "sh -c 'f=$(mktemp) && %s -np %d trabalho2/t2exe -g 0 -w $f && "
+                  "%s -np %d trabalho2/t2exe -r $f; s=$?; rm -f $f; exit $s'", 1, 0, 1},
+  {"incremental", "./gol",                          0, 0, 0},
+  {"change-list", "./gol-change-list 0 0 2 2 1",    0, 0, 0},
+  {"sparse",      "./gol-change-list 0 0 2 2 1 1",  0, 1, 0},
+  {"hashlife",    "./gol-hashlife",                 0, 1, 0},
+};
+#define NENGINES ((int)(sizeof(engines)/sizeof(engines[0])))
+
+typedef struct {
+  int ok;
+  double seconds;
+  double cycles;
+  long rss_kb;
+} sample_t;
+
+typedef struct {
+  const engine_t * engine;
+  int size, threads, generations;
+  double density;
+  sample_t run, io;
+} result_t;
+
+static double tsc_hz;
+static int perf_cycles = 1;
+
+static double now (void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static double measure_tsc (void) {
+  struct timespec pause = {0, 50000000};
+  double t0 = now();
+  unsigned long long c0 = __rdtsc();
+  nanosleep(&pause, NULL);
+  return (__rdtsc() - c0) / (now() - t0);
+}
+
+/* counts the cycles of this process and of the children it waits for */
+static int open_cycles (void) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = PERF_COUNT_HW_CPU_CYCLES;
+  attr.inherit = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/* runs command with input on stdin and output on stdout */
+static sample_t run (const char * command, const char * input, const char * output) {
+  sample_t sample = {0, 0, 0, 0};
+  int fds[2], status;
+  double start = now();
+  pid_t pid;
+
+  if (pipe(fds))
+    return sample;
+  pid = fork();
+  if (pid == 0) {
+    /* stands between the driver and the engine to collect what the engine used */
+    struct rusage usage;
+    long long cycles;
+    int counter = perf_cycles ? open_cycles() : -1;
+    pid_t engine = fork();
+    if (engine == 0) {
+      char shell[4096];
+      int in = open(input, O_RDONLY), out = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      dup2(in, 0);
+      dup2(out, 1);
+      snprintf(shell, sizeof(shell), "exec %s", command);
+      execl("/bin/sh", "sh", "-c", shell, (char *) NULL);
+      _exit(127);
+    }
+    waitpid(engine, &status, 0);
+    getrusage(RUSAGE_CHILDREN, &usage);
+    sample.ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    sample.rss_kb = usage.ru_maxrss;
+    if (counter >= 0 && read(counter, &cycles, sizeof(cycles)) == sizeof(cycles))
+      sample.cycles = cycles;
+    else
+      sample.cycles = -(usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 +
+                        usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6) * tsc_hz;
+    if (write(fds[1], &sample, sizeof(sample)) != sizeof(sample))
+      _exit(1);
+    _exit(0);
+  }
+  close(fds[1]);
+  if (read(fds[0], &sample, sizeof(sample)) != sizeof(sample))
+    sample.ok = 0;
+  close(fds[0]);
+  waitpid(pid, &status, 0);
+  sample.seconds = now() - start;
+  /* a negative count is an estimate; remember that the counter is not there */
+  if (sample.cycles < 0) {
+    perf_cycles = 0;
+    sample.cycles = -sample.cycles;
+  }
+  return sample;
+}
+
+/* writes a board in the input format of the engines, with no live cell
+ * closer than margin to the edge */
+static int write_board (const char * path, int size, int generations, double density,
+                        uint64_t seed, int margin) {
+  FILE * f = fopen(path, "w");
+  char * line = (char *) malloc(size + 2);
+  int i, j;
+  if (!f)
+    return -1;
+  fprintf(f, "%d %d\n", size, generations);
+  for (j = 0; j < size; ++j) {
+    for (i = 0; i < size; ++i)
+      line[i] = i >= margin && i < size - margin && j >= margin && j < size - margin &&
+                random_cell(seed, i, j, density) ? 'x' : ' ';
+    line[size] = '\n';
+    fwrite(line, 1, size + 1, f);
+  }
+  free(line);
+  return fclose(f);
+}
+
+static int same_file (const char * a, const char * b) {
+  FILE * fa = fopen(a, "r"), * fb = fopen(b, "r");
+  int ca, cb, same = fa && fb;
+  while (same) {
+    ca = getc(fa);
+    cb = getc(fb);
+    same = ca == cb;
+    if (ca == EOF)
+      break;
+  }
+  if (fa) fclose(fa);
+  if (fb) fclose(fb);
+  return same;
+}
+
+/* splits a comma separated list */
+static int parse_list (char * list, double * values, int max) {
+  int n = 0;
+  for (char * s = strtok(list, ","); s && n < max; s = strtok(NULL, ","))
+    values[n++] = atof(s);
+  return n;
+}
+
+static void usage (void) {
+  fprintf(stderr,
+    "usage: ./bench [-s sizes] [-d densities] [-t threads] [-g generations]\n"
+    "               [-r seed] [-n repeats] [-e engines] [-j]\n"
+    "  sizes, densities, threads and engines are comma separated lists\n"
+    "  densities are fractions of live cells; -j prints JSON instead of CSV\n"
+    "  MPIRUN overrides the mpirun command line used for t2\n"
+    "  engines:");
+  for (int e = 0; e < NENGINES; ++e)
+    fprintf(stderr, " %s", engines[e].name);
+  fprintf(stderr, "\n");
+  exit(2);
+}
+
+int main (int argc, char ** argv) {
+  char default_sizes[] = "512,2048", default_densities[] = "0.1,0.35", default_threads[] = "1,2,4";
+  char * size_list = default_sizes, * density_list = default_densities, * thread_list = default_threads;
+  char * engine_list = NULL;
+  double sizes[64], densities[64], threads[64];
+  int nsizes, ndensities, nthreads, generations = 100, repeats = 1, json = 0;
+  uint64_t seed = board_seed();
+  const char * mpirun = getenv("MPIRUN") ? getenv("MPIRUN") : "mpirun --oversubscribe";
+  int selected[NENGINES], unbounded = 0, failed = 0, opt, e, s, d, t, r;
+  result_t * results;
+  int nresults = 0;
+  char dir[] = "/tmp/gol-bench.XXXXXX", input[256], empty[256], reference[2][256], output[256],
+       command[1024];
+
+  while ((opt = getopt(argc, argv, "s:d:t:g:r:n:e:j")) != -1) {
+    switch (opt) {
+      case 's': size_list = optarg; break;
+      case 'd': density_list = optarg; break;
+      case 't': thread_list = optarg; break;
+      case 'g': generations = atoi(optarg); break;
+      case 'r': seed = strtoull(optarg, NULL, 0); break;
+      case 'n': repeats = atoi(optarg) > 0 ? atoi(optarg) : 1; break;
+      case 'e': engine_list = optarg; break;
+      case 'j': json = 1; break;
+      default: usage();
+    }
+  }
+  nsizes = parse_list(size_list, sizes, 64);
+  ndensities = parse_list(density_list, densities, 64);
+  nthreads = parse_list(thread_list, threads, 64);
+  for (e = 0; e < NENGINES; ++e) {
+    selected[e] = !engine_list;
+    if (engine_list) {
+      const char * at = strstr(engine_list, engines[e].name);
+      size_t len = strlen(engines[e].name);
+      selected[e] = at && (at == engine_list || at[-1] == ',') && (at[len] == ',' || at[len] == 0);
+    }
+    if (selected[e] && engines[e].unbounded)
+      unbounded = 1;
+  }
+  for (e = 0, t = 0; e < NENGINES; ++e)
+    t += selected[e];
+  if (!t || !nsizes || !ndensities || !nthreads)
+    usage();
+  for (s = 0; s < nsizes; ++s)
+    if (unbounded && sizes[s] <= 2*generations) {
+      fprintf(stderr, "bench: with unbounded engines the size must exceed twice the generations\n");
+      return 2;
+    }
+
+  if (!mkdtemp(dir)) {
+    perror("bench");
+    return 1;
+  }
+  tsc_hz = measure_tsc();
+  results = (result_t *) malloc(sizeof(result_t) * nsizes * ndensities * NENGINES * nthreads);
+  snprintf(input, sizeof(input), "%s/board", dir);
+  snprintf(empty, sizeof(empty), "%s/board0", dir);
+  snprintf(output, sizeof(output), "%s/out", dir);
+  snprintf(reference[0], sizeof(reference[0]), "%s/ref0", dir);
+  snprintf(reference[1], sizeof(reference[1]), "%s/ref", dir);
+
+  for (s = 0; s < nsizes; ++s)
+    for (d = 0; d < ndensities; ++d) {
+      int size = (int) sizes[s], have_reference = 0;
+      const char * reference_name = NULL;
+      int margin = unbounded ? generations : 0;
+      if (write_board(input, size, generations, densities[d], seed, margin) ||
+          write_board(empty, size, 0, densities[d], seed, margin)) {
+        perror("bench");
+        return 1;
+      }
+      for (e = 0; e < NENGINES; ++e) {
+        if (!selected[e])
+          continue;
+        for (t = 0; t < (engines[e].threaded ? nthreads : 1); ++t) {
+          result_t * result = &results[nresults];
+          int n = engines[e].threaded ? (int) threads[t] : 1;
+          if (engines[e].mpi)
+            snprintf(command, sizeof(command), engines[e].command, mpirun, n, mpirun, n);
+          else
+            snprintf(command, sizeof(command), engines[e].command, n);
+          result->engine = &engines[e];
+          result->size = size;
+          result->density = densities[d];
+          result->threads = n;
+          result->generations = generations;
+          /* keep the fastest of the repeats */
+          for (r = 0; r < repeats; ++r) {
+            int agree = 1;
+            sample_t io = run(command, empty, output);
+            if (io.ok && !have_reference)
+              rename(output, reference[0]);
+            else if (io.ok)
+              agree = same_file(output, reference[0]);
+            sample_t played = run(command, input, output);
+            if (played.ok && !have_reference)
+              rename(output, reference[1]);
+            else if (played.ok && agree)
+              agree = same_file(output, reference[1]);
+            if (!io.ok || !played.ok || !agree) {
+              fprintf(stderr, "bench: %s (size %d, density %g, threads %d) ",
+                      engines[e].name, size, densities[d], n);
+              if (!io.ok || !played.ok)
+                fprintf(stderr, "failed: %s\n", command);
+              else
+                fprintf(stderr, "prints a different board than %s\n", reference_name);
+              failed = 1;
+              break;
+            }
+            if (!have_reference)
+              reference_name = engines[e].name;
+            have_reference = 1;
+            if (r == 0 || io.seconds < result->io.seconds)
+              result->io = io;
+            if (r == 0 || played.seconds < result->run.seconds)
+              result->run = played;
+          }
+          nresults++;
+        }
+      }
+    }
+  unlink(input);
+  unlink(empty);
+  unlink(output);
+  unlink(reference[0]);
+  unlink(reference[1]);
+  rmdir(dir);
+  if (failed) {
+    fprintf(stderr, "bench: the engines do not agree, no numbers reported\n");
+    return 1;
+  }
+
+  if (json)
+    printf("[\n");
+  else
+    printf("engine,size,density,threads,generations,seconds,io_seconds,gens_per_s,cells_per_s,"
+           "cycles_per_cell,counter,peak_rss_kb\n");
+  for (r = 0; r < nresults; ++r) {
+    result_t * result = &results[r];
+    double cells = (double) result->size * result->size * result->generations;
+    double seconds = result->run.seconds - result->io.seconds;
+    double cycles = result->run.cycles - result->io.cycles;
+    /* rates are left empty when the generations took less than the noise */
+    char gens[32] = "", rate[32] = "", per_cell[32] = "";
+    if (seconds > 0 && cells > 0) {
+      snprintf(gens, sizeof(gens), "%.3f", result->generations / seconds);
+      snprintf(rate, sizeof(rate), "%.6g", cells / seconds);
+    }
+    if (cycles > 0 && cells > 0)
+      snprintf(per_cell, sizeof(per_cell), "%.4f", cycles / cells);
+    if (json)
+      printf("  {\"engine\": \"%s\", \"size\": %d, \"density\": %g, \"threads\": %d, "
+             "\"generations\": %d, \"seconds\": %.6f, \"io_seconds\": %.6f, \"gens_per_s\": %s, "
+             "\"cells_per_s\": %s, \"cycles_per_cell\": %s, \"counter\": \"%s\", "
+             "\"peak_rss_kb\": %ld}%s\n",
+             result->engine->name, result->size, result->density, result->threads,
+             result->generations, result->run.seconds, result->io.seconds,
+             *gens ? gens : "null", *rate ? rate : "null", *per_cell ? per_cell : "null",
+             perf_cycles ? "perf" : "tsc", result->run.rss_kb, r + 1 < nresults ? "," : "");
+    else
+      printf("%s,%d,%g,%d,%d,%.6f,%.6f,%s,%s,%s,%s,%ld\n",
+             result->engine->name, result->size, result->density, result->threads,
+             result->generations, result->run.seconds, result->io.seconds,
+             gens, rate, per_cell, perf_cycles ? "perf" : "tsc", result->run.rss_kb);
+  }
+  if (json)
+    printf("]\n");
+  free(results);
+  return 0;
+}
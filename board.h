@@ -0,0 +1,71 @@
+/*
+* A square life board in one cache-line-aligned allocation.
+*
+* Cells are indexed board[i][j] -> CELL(board, i, j) with 0 <= i, j < size.
+* Every row is padded to a multiple of BOARD_ALIGN bytes and cell 0 of every
+* row starts a cache line. Rows -1 and size and columns -1 and size form a
+* one-cell halo that is zeroed on allocation, so neighbour reads at the border
+* need no special cases.
+*
+* allocate_rect makes a board of rows x size cells instead, for a process that
+* only holds its own block of a bigger board.
+*
+*/
+#ifndef BOARD_H
+#define BOARD_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+typedef unsigned char cell_t;
+
+#define BOARD_ALIGN 64
+
+typedef struct {
+  int size;          /* cells per side, halo excluded */
+  int rows;          /* rows, halo excluded; size unless made by allocate_rect */
+  ptrdiff_t stride;  /* bytes between the start of two rows */
+  cell_t * data;     /* the allocation, halo rows included */
+  cell_t * cells;    /* cell (0, 0) */
+} board_t;
+
+#define CELL(board, i, j) ((board)->cells[(ptrdiff_t)(i)*(board)->stride + (j)])
+
+/* returns a pointer to cell (i, 0); i may be -1 or size to reach the halo */
+static inline cell_t * board_row (const board_t * board, int i) {
+  return board->cells + (ptrdiff_t)i*board->stride;
+}
+
+/* bytes between two rows of a board with size cells per row; one cache line in
+ * front of cell 0 holds the left halo */
+static inline ptrdiff_t board_stride (int size) {
+  return (BOARD_ALIGN + size + 1 + BOARD_ALIGN - 1) / BOARD_ALIGN * BOARD_ALIGN;
+}
+
+static board_t * allocate_rect (int rows, int size) {
+  board_t * board = (board_t *) malloc(sizeof(board_t));
+  size_t bytes;
+  board->size = size;
+  board->rows = rows;
+  board->stride = board_stride(size);
+  bytes = (size_t)board->stride * (rows + 2);
+  if (posix_memalign((void **)&board->data, BOARD_ALIGN, bytes)) {
+    free(board);
+    return NULL;
+  }
+  memset(board->data, 0, bytes);
+  board->cells = board->data + board->stride + BOARD_ALIGN;
+  return board;
+}
+
+static board_t * allocate_board (int size) {
+  return allocate_rect(size, size);
+}
+
+static void free_board (board_t * board) {
+  free(board->data);
+  free(board);
+}
+
+#endif
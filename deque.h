@@ -0,0 +1,85 @@
+/*
+* A work-stealing deque of ints (Chase and Lev).
+*
+* The owner fills the deque while nobody else is looking (deque_reset and
+* deque_push between two barriers), then takes items from the bottom with
+* deque_pop while other threads take them from the top with deque_steal.
+*
+*/
+#ifndef DEQUE_H
+#define DEQUE_H
+
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#define DEQUE_EMPTY (-1)
+#define DEQUE_ABORT (-2)
+
+typedef struct {
+  atomic_long top;
+  atomic_long bottom;
+  int * items;
+  char pad[64];  /* keep the deques of two threads off the same cache line */
+} deque_t;
+
+static void deque_init (deque_t * deque, long capacity) {
+  atomic_init(&deque->top, 0);
+  atomic_init(&deque->bottom, 0);
+  deque->items = (int *) malloc(capacity*sizeof(int));
+}
+
+static void deque_free (deque_t * deque) {
+  free(deque->items);
+}
+
+static inline void deque_reset (deque_t * deque) {
+  atomic_store_explicit(&deque->top, 0, memory_order_relaxed);
+  atomic_store_explicit(&deque->bottom, 0, memory_order_relaxed);
+}
+
+static inline void deque_push (deque_t * deque, int item) {
+  long b = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+  deque->items[b] = item;
+  atomic_store_explicit(&deque->bottom, b+1, memory_order_relaxed);
+}
+
+/* owner only: returns the bottom item or DEQUE_EMPTY */
+static inline int deque_pop (deque_t * deque) {
+  long b = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+  long t;
+  int item;
+  atomic_store_explicit(&deque->bottom, b, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  t = atomic_load_explicit(&deque->top, memory_order_relaxed);
+  if (t > b) {
+    atomic_store_explicit(&deque->bottom, b+1, memory_order_relaxed);
+    return DEQUE_EMPTY;
+  }
+  item = deque->items[b];
+  if (t == b) {
+    /* last item: race the thieves for it */
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &t, t+1,
+          memory_order_seq_cst, memory_order_relaxed))
+      item = DEQUE_EMPTY;
+    atomic_store_explicit(&deque->bottom, b+1, memory_order_relaxed);
+  }
+  return item;
+}
+
+/* any thread: returns the top item, DEQUE_EMPTY, or DEQUE_ABORT if it lost a race */
+static inline int deque_steal (deque_t * deque) {
+  long t = atomic_load_explicit(&deque->top, memory_order_acquire);
+  long b;
+  int item;
+  atomic_thread_fence(memory_order_seq_cst);
+  b = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+  if (t >= b)
+    return DEQUE_EMPTY;
+  item = deque->items[t];
+  if (!atomic_compare_exchange_strong_explicit(&deque->top, &t, t+1,
+        memory_order_seq_cst, memory_order_relaxed))
+    return DEQUE_ABORT;
+  return item;
+}
+
+#endif
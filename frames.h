@@ -0,0 +1,123 @@
+/*
+* Finished generations, from the simulation thread to the renderer.
+*
+* The simulation writes every cell that changes into its own frame: one
+* byte per cell, and for every 32x32 tile the generation in which it last
+* changed. After a generation it publishes the frame through a triple
+* buffer. It copies the tiles that changed into the back slot and swaps
+* that slot with the middle one, with one atomic exchange. The renderer,
+* whenever it is ready for a frame, swaps the middle slot with its front
+* slot if a newer one is there. Neither side ever waits for the other.
+* The renderer sees the latest generation and skips the ones it was too
+* slow for.
+*
+* Since every slot carries the tile generations, the renderer finds the
+* tiles that changed between the frame it shows and the one it took, however
+* many generations apart they are.
+*
+*/
+#ifndef FRAMES_H
+#define FRAMES_H
+
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <string.h>
+
+#define FRAME_TILE 32   /* cells per side of a tile */
+#define FRAME_FRESH 4   /* the middle slot is newer than the front one */
+
+struct frame_t {
+  long long generation;
+  std::vector<unsigned char> pixels;   /* one byte per cell, row by row */
+  std::vector<long long> changed;      /* per tile, the last generation it changed */
+};
+
+struct frames_t {
+  int size, tiles;
+  frame_t sim;                /* the simulation's own frame */
+  frame_t slots[3];
+  int back, front;            /* owned by the simulation and by the renderer */
+  std::atomic<int> middle;    /* the third slot, and FRAME_FRESH */
+  std::atomic<bool> done;     /* the simulation published its last frame */
+  std::atomic<bool> stop;     /* the renderer wants no more */
+  long long shown;            /* the generation the renderer shows */
+  long long published, taken;
+};
+
+static void frames_init (frames_t * frames, int size) {
+  int k;
+  frames->size = size;
+  frames->tiles = (size + FRAME_TILE - 1) / FRAME_TILE;
+  for (k = 0; k < 4; k++) {
+    frame_t * f = k < 3 ? &frames->slots[k] : &frames->sim;
+    f->generation = -1;
+    f->pixels.assign((size_t)size * size, 0);
+    f->changed.assign((size_t)frames->tiles * frames->tiles, 0);
+  }
+  frames->sim.generation = 0;
+  frames->back = 0;
+  frames->middle = 1;
+  frames->front = 2;
+  frames->done = false;
+  frames->stop = false;
+  frames->shown = -1;
+  frames->published = frames->taken = 0;
+}
+
+/* the simulation: cell (x, y) is alive or dead in generation sim.generation */
+static inline void frame_cell (frames_t * frames, int x, int y, int alive) {
+  frame_t * f = &frames->sim;
+  f->pixels[(size_t)y * frames->size + x] = alive ? 0xff : 0;
+  f->changed[(y / FRAME_TILE) * frames->tiles + x / FRAME_TILE] = f->generation;
+}
+
+/* the simulation: hands over the frame it wrote */
+static void frames_publish (frames_t * frames) {
+  frame_t * sim = &frames->sim, * back = &frames->slots[frames->back];
+  int t, y, size = frames->size;
+  for (t = 0; t < frames->tiles * frames->tiles; t++) {
+    int x0 = (t % frames->tiles) * FRAME_TILE, y0 = (t / frames->tiles) * FRAME_TILE;
+    int w = std::min(FRAME_TILE, size - x0), h = std::min(FRAME_TILE, size - y0);
+    if (sim->changed[t] <= back->generation)
+      continue;
+    for (y = y0; y < y0 + h; y++)
+      memcpy(&back->pixels[(size_t)y * size + x0], &sim->pixels[(size_t)y * size + x0], w);
+  }
+  back->changed = sim->changed;
+  back->generation = sim->generation;
+  frames->back = frames->middle.exchange(frames->back | FRAME_FRESH) & 3;
+  frames->published++;
+}
+
+/* the renderer: the newest frame, or NULL when it already has it */
+static frame_t * frames_latest (frames_t * frames) {
+  if (!(frames->middle.load() & FRAME_FRESH))
+    return NULL;
+  frames->front = frames->middle.exchange(frames->front) & 3;
+  frames->taken++;
+  return &frames->slots[frames->front];
+}
+
+/* the renderer: calls rect(x, y, w, h) for the runs of tiles in a row of
+ * tiles that changed since the frame it shows, and then shows f */
+template <typename F>
+static void frame_changes (frames_t * frames, frame_t * f, F rect) {
+  int tx, ty, end, size = frames->size;
+  for (ty = 0; ty < frames->tiles; ty++) {
+    const long long * changed = &f->changed[(size_t)ty * frames->tiles];
+    for (tx = 0; tx < frames->tiles; tx = end) {
+      if (changed[tx] <= frames->shown) {
+        end = tx + 1;
+        continue;
+      }
+      for (end = tx + 1; end < frames->tiles && changed[end] > frames->shown; end++)
+        ;
+      rect(tx * FRAME_TILE, ty * FRAME_TILE, std::min(end * FRAME_TILE, size) - tx * FRAME_TILE,
+           std::min(FRAME_TILE, size - ty * FRAME_TILE));
+    }
+  }
+  frames->shown = f->generation;
+}
+
+#endif
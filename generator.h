@@ -0,0 +1,36 @@
+/*
+* Reproducible random boards.
+*
+* Whether cell (i, j) starts alive depends only on the seed, the cell and the
+* density, not on the order in which the cells are visited, so every engine
+* builds the same board from the same seed. The seed is read from GOL_SEED and
+* defaults to 1.
+*
+*/
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/* the splitmix64 finaliser */
+static inline uint64_t mix64 (uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+static uint64_t board_seed (void) {
+  const char * seed = getenv("GOL_SEED");
+  return seed ? strtoull(seed, NULL, 0) : 1;
+}
+
+/* nonzero if cell (i, j) starts alive; density is the fraction of live cells */
+static inline int random_cell (uint64_t seed, int i, int j, double density) {
+  uint64_t h = mix64(seed ^ mix64((uint64_t)(uint32_t)i << 32 | (uint32_t)j));
+  return (double)(h >> 11) * (1.0 / 9007199254740992.0) < density;
+}
+
+#endif
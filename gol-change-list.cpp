@@ -13,166 +13,449 @@
 *
 */
 
-#include <SDL2/SDL.h>
-#include <SDL2/SDL_render.h>
 #include <iostream>
 #include <vector>
 #include <stdio.h>
 #include <stdlib.h>
 #include "./array_list.h"
-#include <time.h>
+#include "./board.h"
+#include "./generator.h"
+#include "./loader.h"
+#include "./output.h"
+#include "./snapshot.h"
 #include <cassert>
+#include <stdint.h>
+#include <unordered_map>
 
 
 using namespace std;
-typedef unsigned char cell_t;
 
-cell_t ** allocate_board (int size) {
-  cell_t ** board = (cell_t **) (malloc(sizeof(cell_t*)*size+2))+1;
-  int   i;
-  for (i=-1; i<size+1; i++)
-    board[i] = (cell_t *) (malloc(sizeof(cell_t)*size+2))+1;
-  return board;
-}
+/* the cells that can change in the next generation, as offsets from cell
+ * (0, 0) in increasing order, so the list is walked in memory order */
+typedef structures::ArrayList<uint32_t> cell_list;
 
+#define CELL_LIST_END UINT32_MAX  /* past the last offset of any board */
 
-void free_board (cell_t ** board, int size) {
-  int     i;
-  for (i=0; i<size; i++)
-  free(board[i]);
-  free(board);
+/* return the number of on cells adjacent to cell c of a board with rows
+ * s bytes apart */
+static inline int adjacent (const cell_t * c, ptrdiff_t s) {
+  int count = 0;
+  count+=c[-s-1];
+  count+=c[-s];
+  count+=c[-s+1];
+  count+=c[-1];
+  count+=c[1];
+  count+=c[s-1];
+  count+=c[s];
+  count+=c[s+1];
+  return count&0xf;
 }
 
-
 /* return the number of on cells adjacent to the i,j cell */
-int adjacent_to (cell_t ** board, int i, int j) {
-  int count = 0;
-  count+=board[i-1][j-1];
-  count+=board[i-1][j];
-  count+=board[i-1][j+1];
-  count+=board[i][j-1];
-  count+=board[i][j+1];
-  count+=board[i+1][j-1];
-  count+=board[i+1][j];
-  count+=board[i+1][j+1];
-  return count&0xf;
+int adjacent_to (board_t * board, int i, int j) {
+  return adjacent(&CELL(board, i, j), board->stride);
 }
 
 
-inline void push(structures::ArrayList<std::pair<int,int>>* new_live_cells, int i, int j, cell_t** newboard){
-  if (newboard[i][j]>>4){
-    new_live_cells->push_back(pair<int,int>{i,j});
-    newboard[i][j] &= 0x1;
+/* bit 0x10 of a cell of board means it is already in the next change list;
+ * the halo has it set for good so it is never listed */
+inline void push(cell_list* new_live_cells, ptrdiff_t p, board_t* board){
+  if (!(board->cells[p]>>4)){
+    new_live_cells->push_back(p);
+    board->cells[p] |= 0x10;
   }
 }
 
-void play (cell_t ** board, cell_t ** newboard, int size, structures::ArrayList<std::pair<int,int>>* old_live_cells
-  , structures::ArrayList<std::pair<int,int>>* new_live_cells, int print) {
-  int	pos, i, j, a;
+/* merges the three sorted lists of rows into list */
+static void merge_rows (cell_list* list, cell_list* rows) {
+  size_t n = rows[0].size() + rows[1].size() + rows[2].size();
+  list->clear();
+  list->reserve(n);
+  for (int k = 0; k < 3; ++k)
+    rows[k].push_back(CELL_LIST_END);
+  const uint32_t * a = rows[0].data(), * b = rows[1].data(), * c = rows[2].data();
+  for (; n; --n) {
+    if (*a < *b)
+      list->push_back(*a < *c ? *a++ : *c++);
+    else
+      list->push_back(*b < *c ? *b++ : *c++);
+  }
+}
+
+/* a cell that is not in the change list keeps its state, so both boards hold
+ * the current generation everywhere except at the listed cells */
+/* rows holds three scratch lists */
+void play (board_t * board, board_t * newboard, cell_list* old_live_cells
+  , cell_list* new_live_cells, cell_list* rows, int print) {
+  size_t pos;
+  int a;
+  const ptrdiff_t s = board->stride;
+  cell_t * cells = board->cells, * next = newboard->cells;
 
   /* for each cell, apply the rules of Life */
-  new_live_cells->clear();
-  if (print){
-      printf("size: %d\n", old_live_cells->size());
+  if (print == 1){
+      output_title("size: %zu\n", old_live_cells->size());
   }
   for (pos=0; pos<old_live_cells->size(); pos++){
-      auto p = old_live_cells->at(pos);
-      i = p.first; j = p.second;
-      a = adjacent_to (board, i, j);
-      //printf("i:%d j:%d newboard: %d  board:%d a: %d\n", i, j, newboard[i][j], board[i][j], a);
+      uint32_t p = old_live_cells->at(pos);
+      a = adjacent (cells + p, s);
       if (a == 2){
-        newboard[i][j] = board[i][j] | 0x10;
+        next[p] = cells[p];
       } else if (a == 3) {
-        newboard[i][j] = 0x11 ;
+        next[p] = 0x1;
       } else {
-        newboard[i][j] = 0x10;
+        next[p] = 0;
       }
   }
+  /* the cells that changed and their neighbours go in the next list. The
+   * neighbours above, beside and below go in a list each: every one of them
+   * comes out sorted, since the old list is and a cell is listed only once */
+  for (int k = 0; k < 3; ++k)
+    rows[k].clear();
   for (pos=0; pos<old_live_cells->size(); pos++){
-      auto p = old_live_cells->at(pos);
-      int i = p.first;
-      int j = p.second;
-      if ((board[i][j]& 0x1)) {
-        push(new_live_cells, i, j, newboard);
-        push(new_live_cells, i-1, j-1, newboard);
-        push(new_live_cells, i-1, j, newboard);
-        push(new_live_cells, i-1, j+1, newboard);
-        push(new_live_cells, i, j-1, newboard);
-        push(new_live_cells, i, j+1, newboard);
-        push(new_live_cells, i+1, j-1, newboard);
-        push(new_live_cells, i+1, j, newboard);
-        push(new_live_cells, i+1, j+1, newboard);
+      ptrdiff_t p = old_live_cells->at(pos);
+      if ((cells[p] ^ next[p]) & 0x1) {
+        push(&rows[0], p-s-1, board);
+        push(&rows[0], p-s, board);
+        push(&rows[0], p-s+1, board);
+        push(&rows[1], p-1, board);
+        push(&rows[1], p, board);
+        push(&rows[1], p+1, board);
+        push(&rows[2], p+s-1, board);
+        push(&rows[2], p+s, board);
+        push(&rows[2], p+s+1, board);
       }
     }
+  merge_rows(new_live_cells, rows);
+  /* bring board up to date, which also clears the flags */
+  for (pos=0; pos<new_live_cells->size(); pos++){
+      uint32_t p = new_live_cells->at(pos);
+      cells[p] = next[p];
+  }
 }
 
 /* print the life board */
-void print (cell_t ** board, int size) {
-  int	i, j;
-  /* for each row */
-  for (j=0; j<size; j++) {
-    /* print each column position... */
-    for (i=0; i<size; i++)
-	      if (board[i][j] & 0x1){
-	          printf ("■ ");
-        }else{
-	          printf ("□ ");
-        }
-    /* followed by a carriage return */
-    printf ("\n");
-  }
+void print (board_t * board) {
+  output_t out;
+  int	j;
+  output_begin(&out, board->size);
+  for (j=0; j<board->size; j++)
+    output_cells(&out, board_row(board, j), 0x1);
+  output_end(&out);
 }
 
-void fill_board(cell_t ** board, cell_t ** next, int size, int percentage_alive) {
+void fill_board(board_t * board, board_t * next, int percentage_alive) {
   int	i, j;
-  srand(time(NULL));
-  for (j=0; j<size; j++) {
-    for (i=0; i<size; i++){
-	    board[i][j] = ((int)(rand()) %percentage_alive == 0? 1 : 0 ) | 0x10;
-      next[i][j] = board[i][j];
-      assert(board[i][j]>>4);
+  uint64_t seed = board_seed();
+  for (j=0; j<board->size; j++) {
+    for (i=0; i<board->size; i++){
+	    CELL(board, j, i) = random_cell(seed, i, j, 1.0/percentage_alive);
+      CELL(next, j, i) = CELL(board, j, i);
     }
   }
-  for (j=-1; j<size+1; j++) {
-    board[-1][j] = 0;
-    board[j][-1] = 0;
-    board[size][j] = 0;
-    board[j][size] = 0;
-    next[-1][j] = 0;
-    next[j][-1] = 0;
-    next[size][j] = 0;
-    next[j][size] = 0;
+}
+
+/* row j of the file goes to row j of both boards */
+/* hands the board to the snapshot writer when a snapshot is due */
+void snapshot (snapshots_t * snapshots, board_t * board, long long generation) {
+  uint64_t * words = snapshot_take(snapshots, generation);
+  if (!words)
+    return;
+  for (int j = 0; j < board->size; ++j)
+    snapshot_cells(snapshots, words, j, board_row(board, j), 0x1);
+  snapshot_give(snapshots);
+}
+
+int read_file (board_text_t * text, board_t * board, board_t * board2) {
+  if (board_text_cells(text, board_row(board, 0), board->stride, 1))
+    return -1;
+  /* a pattern can only be decoded once */
+  for (int j = 0; j < board->size; ++j)
+    memcpy(board_row(board2, j), board_row(board, j), board->size);
+  return 0;
+}
+
+/* the halo is never listed */
+void flag_halo (board_t * board) {
+  int size = board->size;
+  for (int i=-1; i<size+1; i++){
+    CELL(board, -1, i) = 0x10;
+    CELL(board, size, i) = 0x10;
+    CELL(board, i, -1) = 0x10;
+    CELL(board, i, size) = 0x10;
+  }
+}
+
+
+/* ------------------------------------------------------------------------- */
+/* sparse mode: an unbounded plane of 64x64 chunks kept in a hash table.
+ * A chunk is allocated when a cell may be born in it and freed once it has
+ * been empty for a generation, so memory follows the population. Every chunk
+ * is one 64-bit word per row, played with the adders of trabalho/bitboard.c.
+ * The change list holds the chunks that changed in the last generation and
+ * their neighbours; every other chunk keeps its state without being visited. */
+
+#define CHUNK 64
+
+/* N NE E SE S SW W NW */
+static const int chunk_dx[8] = {0, 1, 1, 1, 0, -1, -1, -1};
+static const int chunk_dy[8] = {-1, -1, 0, 1, 1, 1, 0, -1};
+
+struct chunk {
+  int cx, cy;
+  uint64_t rows[2][CHUNK];  /* bit x of rows[g][y] is cell (x, y) of generation g */
+  chunk * neighbours[8];    /* null when not allocated */
+  bool changed;             /* changed in the last generation */
+  bool listed;              /* already in this generation's change list */
+};
+
+static std::unordered_map<uint64_t, chunk *> chunks;
+static int gen = 0;         /* which of rows[] holds the current generation */
+
+static inline uint64_t chunk_key(int cx, int cy) {
+  return (uint64_t)(uint32_t)cx << 32 | (uint32_t)cy;
+}
+
+static chunk * find_chunk(int cx, int cy) {
+  auto it = chunks.find(chunk_key(cx, cy));
+  return it == chunks.end() ? nullptr : it->second;
+}
+
+static chunk * new_chunk(int cx, int cy) {
+  chunk * c = new chunk();
+  c->cx = cx;
+  c->cy = cy;
+  c->changed = true;
+  for (int d = 0; d < 8; ++d) {
+    chunk * n = find_chunk(cx + chunk_dx[d], cy + chunk_dy[d]);
+    c->neighbours[d] = n;
+    if (n)
+      n->neighbours[(d+4)%8] = c;
   }
+  chunks[chunk_key(cx, cy)] = c;
+  return c;
 }
 
-void read_file (FILE * f, cell_t ** board, cell_t ** board2, int size) {
-  int	i, j;
-  char	*s = (char *) malloc(size+10);
+static void free_chunk(chunk * c) {
+  for (int d = 0; d < 8; ++d)
+    if (c->neighbours[d])
+      c->neighbours[d]->neighbours[(d+4)%8] = nullptr;
+  chunks.erase(chunk_key(c->cx, c->cy));
+  delete c;
+}
+
+static inline int floor_div(int64_t a) {
+  return (int)(a >= 0 ? a / CHUNK : -((-a + CHUNK - 1) / CHUNK));
+}
+
+static void set_cell(int64_t x, int64_t y) {
+  int cx = floor_div(x), cy = floor_div(y);
+  chunk * c = find_chunk(cx, cy);
+  if (!c)
+    c = new_chunk(cx, cy);
+  c->rows[gen][y - (int64_t)cy*CHUNK] |= (uint64_t)1 << (x - (int64_t)cx*CHUNK);
+}
+
+/* allocates the neighbours a chunk could give birth to */
+static void grow_chunk(chunk * c) {
+  const uint64_t * r = c->rows[gen];
+  uint64_t west = 0, east = 0;
+  for (int y = 0; y < CHUNK; ++y) {
+    west |= r[y] & 1;
+    east |= r[y] >> (CHUNK-1);
+  }
+  bool need[8] = {r[0] != 0, (r[0] >> (CHUNK-1)) != 0, east != 0, (r[CHUNK-1] >> (CHUNK-1)) != 0,
+                  r[CHUNK-1] != 0, (r[CHUNK-1] & 1) != 0, west != 0, (r[0] & 1) != 0};
+  for (int d = 0; d < 8; ++d)
+    if (need[d] && !c->neighbours[d])
+      new_chunk(c->cx + chunk_dx[d], c->cy + chunk_dy[d]);
+}
+
+static inline uint64_t row_of(chunk * c, int y) {
+  return c ? c->rows[gen][y] : 0;
+}
+
+/* plays one chunk into rows[!gen]; returns true if it changed */
+static bool play_chunk(chunk * c) {
+  chunk ** nb = c->neighbours;
+  /* rows -1..64 of the chunk and of its west and east neighbours */
+  uint64_t m[CHUNK+2], w[CHUNK+2], e[CHUNK+2];
+  m[0] = row_of(nb[0], CHUNK-1);
+  w[0] = row_of(nb[7], CHUNK-1);
+  e[0] = row_of(nb[1], CHUNK-1);
+  for (int y = 0; y < CHUNK; ++y) {
+    m[y+1] = c->rows[gen][y];
+    w[y+1] = row_of(nb[6], y);
+    e[y+1] = row_of(nb[2], y);
+  }
+  m[CHUNK+1] = row_of(nb[4], 0);
+  w[CHUNK+1] = row_of(nb[5], 0);
+  e[CHUNK+1] = row_of(nb[3], 0);
+
+  uint64_t diff = 0;
+  for (int y = 1; y <= CHUNK; ++y) {
+    uint64_t aw = m[y-1] << 1 | w[y-1] >> (CHUNK-1), ae = m[y-1] >> 1 | e[y-1] << (CHUNK-1);
+    uint64_t mw = m[y] << 1 | w[y] >> (CHUNK-1), me = m[y] >> 1 | e[y] << (CHUNK-1);
+    uint64_t bw = m[y+1] << 1 | w[y+1] >> (CHUNK-1), be = m[y+1] >> 1 | e[y+1] << (CHUNK-1);
+    /* full adders: count = s0 + 2*(twos), alive when the twos add up to 1 */
+    uint64_t t, us, uc, ds, dc, s0, c0, ts, tc;
+    t = aw ^ m[y-1]; us = t ^ ae; uc = (aw & m[y-1]) | (t & ae);
+    t = bw ^ m[y+1]; ds = t ^ be; dc = (bw & m[y+1]) | (t & be);
+    uint64_t ms = mw ^ me, mc = mw & me;
+    t = us ^ ms; s0 = t ^ ds; c0 = (us & ms) | (t & ds);
+    t = uc ^ mc; ts = t ^ dc; tc = (uc & mc) | (t & dc);
+    uint64_t next = ~tc & (ts ^ c0) & (s0 | m[y]);
+    c->rows[!gen][y-1] = next;
+    diff |= next ^ m[y];
+  }
+  return diff != 0;
+}
+
+static void list_chunk(structures::ArrayList<chunk *> * list, chunk * c) {
+  if (c && !c->listed) {
+    c->listed = true;
+    list->push_back(c);
+  }
+}
 
-  /* read the first new line (it will be ignored) */
-  fgets (s, size+10,f);
+void play_sparse(structures::ArrayList<chunk *> * list, std::vector<chunk *> & all) {
+  all.clear();
+  for (auto & it : chunks)
+    all.push_back(it.second);
+  for (chunk * c : all)
+    if (c->changed)
+      grow_chunk(c);
+
+  list->clear();
+  for (auto & it : chunks) {
+    chunk * c = it.second;
+    if (c->changed) {
+      list_chunk(list, c);
+      for (int d = 0; d < 8; ++d)
+        list_chunk(list, c->neighbours[d]);
+    }
+  }
+  /* the chunks that are not listed already hold their next state in rows[!gen] */
+  bool * changed = new bool[list->size()];
+  for (size_t k = 0; k < list->size(); ++k)
+    changed[k] = play_chunk(list->at(k));
+  for (size_t k = 0; k < list->size(); ++k) {
+    list->at(k)->changed = changed[k];
+    list->at(k)->listed = false;
+  }
+  delete[] changed;
+  gen = !gen;
+
+  /* chunks that stayed empty for a generation go away */
+  all.clear();
+  for (auto & it : chunks) {
+    chunk * c = it.second;
+    if (!c->changed) {
+      uint64_t live = 0;
+      for (int y = 0; y < CHUNK; ++y)
+        live |= c->rows[gen][y];
+      if (!live)
+        all.push_back(c);
+    }
+  }
+  for (chunk * c : all)
+    free_chunk(c);
+}
+
+/* print the part of the plane covered by the board */
+/* row j of the board, one bit per cell; band caches the chunks of the
+ * rows around it, so there is one lookup per chunk, not per cell */
+static void plane_row (int size, int j, std::vector<chunk *> & band, uint64_t * row) {
+  int cx, words = (size + CHUNK - 1) / CHUNK;
+  if (j % CHUNK == 0)
+    for (cx=0; cx<words; cx++)
+      band[cx] = find_chunk(cx, j / CHUNK);
+  for (cx=0; cx<words; cx++)
+    row[cx] = band[cx] ? band[cx]->rows[gen][j % CHUNK] : 0;
+  /* the plane goes on past the board */
+  if (size % CHUNK)
+    row[words-1] &= ((uint64_t)1 << size % CHUNK) - 1;
+}
 
-  /* read the life board */
+void print_sparse (int size) {
+  output_t out;
+  int	j, words = (size + CHUNK - 1) / CHUNK;
+  std::vector<chunk *> band(words);
+  std::vector<uint64_t> row(words);
+  output_begin(&out, size);
   for (j=0; j<size; j++) {
-    /* get a string */
-    fgets (s, size+10,f);
-    /* copy the string to the life board */
-    for (i=0; i<size; i++){
-      int a = (s[i] == 'x') |0x10;
-      board[i][j] = a;
-      //board2[i][j] = a;
+    plane_row(size, j, band, row.data());
+    output_bits(&out, row.data());
+  }
+  output_end(&out);
+}
+
+/* hands the board to the snapshot writer when a snapshot is due */
+void snapshot_sparse (snapshots_t * snapshots, int size, long long generation) {
+  uint64_t * words = snapshot_take(snapshots, generation);
+  std::vector<chunk *> band((size + CHUNK - 1) / CHUNK);
+  if (!words)
+    return;
+  for (int j = 0; j < size; ++j)
+    plane_row(size, j, band, words + (size_t)j*snapshots->words);
+  snapshot_give(snapshots);
+}
+
+static void set_run (void *, int x, int y, int n) {
+  for (int k = 0; k < n; ++k)
+    set_cell(x + k, y);
+}
+
+/* only the live cells are visited */
+int read_file_sparse (board_text_t * text) {
+  return board_text_runs(text, set_run, NULL);
+}
+
+void fill_sparse(int size, int percentage_alive) {
+  int	i, j;
+  uint64_t seed = board_seed();
+  for (j=0; j<size; j++)
+    for (i=0; i<size; i++)
+      if (random_cell(seed, i, j, 1.0/percentage_alive))
+        set_cell(i, j);
+}
+
+void run_sparse(int size, int steps, int dead, int should_print, int use_file) {
+  if (use_file){
+    board_text_t text;
+    if (board_text_open(stdin, &text))
+      exit(1);
+    size = text.size;
+    steps = text.steps;
+    if (read_file_sparse (&text))
+      exit(1);
+    board_text_close(&text);
+  } else {
+    fill_sparse(size, dead);
+  }
+  auto list = new structures::ArrayList<chunk *>{};
+  std::vector<chunk *> all;
+  if (should_print == 1){
+      print_sparse(size);
+  }
+  snapshots_t * snapshots = snapshots_start(size, steps);
+  snapshot_sparse(snapshots, size, 0);
+  for (int i=0; i<steps; i++) {
+    /* every chunk can end up in the change list */
+    list->reserve(9*chunks.size());
+    play_sparse(list, all);
+    if (should_print == 1){
+        output_title("chunks: %zu\n", chunks.size());
+        print_sparse(size);
     }
+    snapshot_sparse(snapshots, size, i + 1);
   }
-  for (j=-1; j<size+1; j++) {
-    board[-1][j] = 0;
-    board[j][-1] = 0;
-    board[size][j] = 0;
-    board[j][size] = 0;
-    //board2[-1][j] = 0;
-    //board2[j][-1] = 0;
-    //board2[size][j] = 0;
-    //board2[j][size] = 0;
+  snapshots_finish(snapshots);
+  if (should_print == 2){
+      output_title("Final:\n");
+      print_sparse(size);
   }
+  delete list;
 }
 
 
@@ -180,55 +463,87 @@ void read_file (FILE * f, cell_t ** board, cell_t ** board2, int size) {
 // e para rodar time cat input-big.in | ./output 11 7 8 0 1
 // ele ignora os parametros 11 7 e 8, que são o size, steps, e um numero para escolher a proporcao de celulas vivas
 // o 0 diz para não imprimir o quadro, e o 1 diz para ler o arquivo ao invés de gerar um quadro aleatório
+// (imprimir com 1 mostra todas as gerações, com 2 só o quadro final, como as outras versões)
 // para rodar o input-little use time cat input-little.in | ./output 11 7 8 1 1
+// um sexto parametro 1 usa o plano infinito esparso (o quadro impresso continua sendo size x size)
 int main(int argc, char**argv){
   int size = std::atoi(argv[1]);
   int steps = std::atoi(argv[2]);
   int dead = std::atoi(argv[3]);
   int should_print = std::atoi(argv[4]);
   int use_file = std::atoi(argv[5]);
-  cell_t ** prev;
-  cell_t ** next;
+  if (argc > 6 && std::atoi(argv[6])){
+    run_sparse(size, steps, dead, should_print, use_file);
+    return 0;
+  }
+  board_t * prev;
+  board_t * next;
   if (use_file){
-    FILE    *f;
-    f = stdin;
-    fscanf(f,"%d %d", &size, &steps);
+    board_text_t text;
+    if (board_text_open(stdin, &text))
+      return 1;
+    size = text.size;
+    steps = text.steps;
     prev = allocate_board (size);
     next = allocate_board (size);
-    read_file (f, prev, next, size);
-    fclose(f);
+    if (read_file (&text, prev, next))
+      return 1;
+    board_text_close(&text);
   } else {
     prev = allocate_board (size);
     next = allocate_board (size);
-    fill_board(prev, next, size, dead);
+    fill_board(prev, next, dead);
+  }
+  if ((uint64_t)size * prev->stride >= CELL_LIST_END){
+    fprintf(stderr, "a board of size %d is too big for the change list, use the sparse plane\n", size);
+    return 1;
   }
-  cell_t ** tmp;
+  flag_halo(prev);
+  flag_halo(next);
+  board_t * tmp;
 
   int i;
   //print(prev,size);
-  auto old_live_cells = new structures::ArrayList<std::pair<int,int>>{(size_t)size*size};
-  auto new_live_cells = new structures::ArrayList<std::pair<int,int>>{(size_t)size*size};
-  structures::ArrayList<std::pair<int,int>>* temp;
+  /* only a live cell or a neighbour of one can change, and the lists grow
+   * with the activity of the board */
+  auto old_live_cells = new cell_list{};
+  auto new_live_cells = new cell_list{};
+  cell_list rows[3];
+  cell_list* temp;
   for (int i = 0; i<size; ++i){
     for (int j = 0; j<size; ++j){
-      old_live_cells->push_back(std::pair<int,int>{i,j});
+      if ((CELL(prev, i, j) & 0x1) || adjacent_to(prev, i, j)){
+        old_live_cells->push_back(&CELL(prev, i, j) - prev->cells);
+      }
     }
   }
   bool running = true;
 
-  if (should_print){
-      print(prev, size);
+  if (should_print == 1){
+      print(prev);
   }
+  snapshots_t * snapshots = snapshots_start(size, steps);
+  snapshot(snapshots, prev, 0);
   for (i=0; i<steps&&running; i++) {
-    play (prev,next,size,  old_live_cells, new_live_cells, should_print);
+    play (prev,next, old_live_cells, new_live_cells, rows, should_print);
     tmp = next;
     next = prev;
     prev = tmp;
     temp = old_live_cells;
     old_live_cells = new_live_cells;
     new_live_cells = temp;
-    if (should_print){
-        print(prev, size);
+    if (should_print == 1){
+        print(prev);
     }
+    snapshot(snapshots, prev, i + 1);
+  }
+  snapshots_finish(snapshots);
+  if (should_print == 2){
+      output_title("Final:\n");
+      print(prev);
   }
+  delete old_live_cells;
+  delete new_live_cells;
+  free_board(prev);
+  free_board(next);
 }
@@ -0,0 +1,40 @@
+/*
+* Converts a board between the input formats.
+*
+* It reads any input the engines read (a dense grid, RLE, Life 1.06 or
+* macrocell, see patterns.h) and writes it back with the same size and
+* steps in the format given on the command line, so a sparse pattern can be
+* stored in a few bytes and a pattern can be expanded for a tool that only
+* reads grids.
+*
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "./loader.h"
+
+// usage: ./gol-convert text|rle|life106|mc < input > output
+int main (int argc, char ** argv) {
+  board_text_t text;
+  uint64_t * cells;
+  size_t words;
+  int format;
+  for (format = 0; argc > 1 && format <= FORMAT_MACROCELL; format++)
+    if (!strcmp(argv[1], format_names[format]))
+      break;
+  if (argc != 2 || format > FORMAT_MACROCELL) {
+    fprintf(stderr, "usage: %s text|rle|life106|mc < input > output\n", argv[0]);
+    return 2;
+  }
+  if (board_text_open(stdin, &text))
+    return 1;
+  words = ((size_t)text.size + 63) / 64;
+  cells = (uint64_t *) calloc((size_t)text.size * words, sizeof(uint64_t));
+  if (board_text_bits(&text, cells, words))
+    return 1;
+  board_text_close(&text);
+  write_pattern(stdout, format, text.size, text.steps, cells, words);
+  free(cells);
+  return 0;
+}
@@ -0,0 +1,393 @@
+/*
+* The Game of Life
+*
+* a cell is born, if it has exactly three neighbours
+* a cell dies of loneliness, if it has less than two neighbours
+* a cell dies of overcrowding, if it has more than three neighbours
+* a cell survives to the next generation, if it does not die of loneliness
+* or overcrowding
+*
+* In this version the board is a quadtree of hash-consed nodes (HashLife):
+* equal squares are stored once and the future of every square is memoised,
+* so regular patterns can be advanced billions of generations.
+*
+* It reads the same input as the other versions and prints the same final
+* board. HashLife works on an unbounded plane, so the result matches the
+* bounded versions as long as the pattern never reaches the edge of the board;
+* a warning is printed when live cells end up outside of it.
+*
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include "./loader.h"
+#include "./output.h"
+#include "./snapshot.h"
+
+struct node {
+  node * nw, * ne, * sw, * se;  /* null for the two leaves */
+  node * result;                /* centre, 2^min(level-2, step_log) generations later */
+  node * next;                  /* hash chain */
+  uint64_t population;
+  int level;
+  bool marked;
+};
+
+static node dead_leaf = {0, 0, 0, 0, 0, 0, 0, 0, false};
+static node live_leaf = {0, 0, 0, 0, 0, 0, 1, 0, false};
+
+/* the node cache */
+static std::vector<node *> buckets(1 << 16);
+static size_t node_count = 0;
+static size_t max_bytes;
+static std::vector<node *> empty_nodes;  /* the empty square of every level */
+static int step_log = 0;
+
+static size_t used_bytes() {
+  return node_count * sizeof(node) + buckets.size() * sizeof(node *);
+}
+
+static inline size_t hash_node(node * nw, node * ne, node * sw, node * se) {
+  size_t h = (size_t)nw;
+  h = h * 1000003 ^ (size_t)ne;
+  h = h * 1000003 ^ (size_t)sw;
+  h = h * 1000003 ^ (size_t)se;
+  return h ^ (h >> 17);
+}
+
+static void rehash(size_t size) {
+  std::vector<node *> old(size, nullptr);
+  old.swap(buckets);
+  for (node * n : old) {
+    while (n) {
+      node * next = n->next;
+      size_t b = hash_node(n->nw, n->ne, n->sw, n->se) & (buckets.size() - 1);
+      n->next = buckets[b];
+      buckets[b] = n;
+      n = next;
+    }
+  }
+}
+
+/* returns the canonical node with the given quadrants */
+static node * find_node(node * nw, node * ne, node * sw, node * se) {
+  size_t b = hash_node(nw, ne, sw, se) & (buckets.size() - 1);
+  for (node * n = buckets[b]; n; n = n->next)
+    if (n->nw == nw && n->ne == ne && n->sw == sw && n->se == se)
+      return n;
+  node * n = new node;
+  n->nw = nw; n->ne = ne; n->sw = sw; n->se = se;
+  n->result = nullptr;
+  n->population = nw->population + ne->population + sw->population + se->population;
+  n->level = nw->level + 1;
+  n->marked = false;
+  n->next = buckets[b];
+  buckets[b] = n;
+  if (++node_count > buckets.size())
+    rehash(buckets.size() * 2);
+  return n;
+}
+
+static node * empty_node(int level) {
+  while ((int)empty_nodes.size() <= level) {
+    if (empty_nodes.empty()) {
+      empty_nodes.push_back(&dead_leaf);
+    } else {
+      node * e = empty_nodes.back();
+      empty_nodes.push_back(find_node(e, e, e, e));
+    }
+  }
+  return empty_nodes[level];
+}
+
+/* ------------------------------------------------------------------------- */
+/* garbage collection: keep what is reachable from the roots, drop the rest.
+ * A result is reachable from its node, so the memoized steps of the nodes
+ * that stay are kept and the next step does not start from scratch. When
+ * that is still over the cap, the results go and only the board is kept. */
+
+static void mark(node * n) {
+  if (n->level == 0 || n->marked)
+    return;
+  n->marked = true;
+  mark(n->nw); mark(n->ne); mark(n->sw); mark(n->se);
+  if (n->result)
+    mark(n->result);
+}
+
+static void forget_results() {
+  for (node * head : buckets)
+    for (node * n = head; n; n = n->next)
+      n->result = nullptr;
+}
+
+static void sweep(node * root) {
+  size_t size = 1 << 16;
+  mark(root);
+  for (node * e : empty_nodes)
+    mark(e);
+  for (node *& head : buckets) {
+    node ** link = &head;
+    while (*link) {
+      node * n = *link;
+      if (n->marked) {
+        n->marked = false;
+        link = &n->next;
+      } else {
+        *link = n->next;
+        delete n;
+        node_count--;
+      }
+    }
+  }
+  /* the table shrinks with the nodes */
+  while (size < node_count)
+    size *= 2;
+  if (size < buckets.size())
+    rehash(size);
+}
+
+static void collect(node * root) {
+  sweep(root);
+  if (used_bytes() <= max_bytes)
+    return;
+  forget_results();
+  sweep(root);
+  if (used_bytes() > max_bytes) {
+    fprintf(stderr, "the board alone needs %.1f MB, over the cap of %zu MB\n",
+            used_bytes() / 1048576.0, max_bytes >> 20);
+    exit(1);
+  }
+}
+
+/* results are only valid for one step size */
+static void set_step(int log) {
+  if (log == step_log)
+    return;
+  step_log = log;
+  forget_results();
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* the centred level-2 square of the four level-1 squares of a level-2 node,
+ * one generation later */
+static node * base_result(node * n) {
+  int cells[4][4];
+  node * quads[2][2] = {{n->nw, n->ne}, {n->sw, n->se}};
+  for (int qy = 0; qy < 2; ++qy)
+    for (int qx = 0; qx < 2; ++qx) {
+      node * q = quads[qy][qx];
+      cells[qy*2][qx*2] = q->nw->population;
+      cells[qy*2][qx*2+1] = q->ne->population;
+      cells[qy*2+1][qx*2] = q->sw->population;
+      cells[qy*2+1][qx*2+1] = q->se->population;
+    }
+  node * next[2][2];
+  for (int y = 1; y < 3; ++y)
+    for (int x = 1; x < 3; ++x) {
+      int a = 0;
+      for (int dy = -1; dy <= 1; ++dy)
+        for (int dx = -1; dx <= 1; ++dx)
+          if (dx || dy)
+            a += cells[y+dy][x+dx];
+      int alive = a == 3 || (a == 2 && cells[y][x]);
+      next[y-1][x-1] = alive ? &live_leaf : &dead_leaf;
+    }
+  return find_node(next[0][0], next[0][1], next[1][0], next[1][1]);
+}
+
+/* the centred square one level down, without advancing */
+static node * centre(node * n) {
+  return find_node(n->nw->se, n->ne->sw, n->sw->ne, n->se->nw);
+}
+
+static node * horizontal(node * w, node * e) {
+  return find_node(w->ne, e->nw, w->se, e->sw);
+}
+
+static node * vertical(node * n, node * s) {
+  return find_node(n->sw, n->se, s->nw, s->ne);
+}
+
+/* the centre of n (level-1), 2^min(level-2, step_log) generations later */
+static node * result(node * n) {
+  if (n->result)
+    return n->result;
+  if (n->population == 0)
+    return n->result = empty_node(n->level - 1);
+  if (n->level == 2)
+    return n->result = base_result(n);
+
+  /* nine overlapping squares one level down */
+  node * n00 = n->nw, * n02 = n->ne, * n20 = n->sw, * n22 = n->se;
+  node * n01 = horizontal(n->nw, n->ne);
+  node * n21 = horizontal(n->sw, n->se);
+  node * n10 = vertical(n->nw, n->sw);
+  node * n12 = vertical(n->ne, n->se);
+  node * n11 = centre(n);
+
+  bool full_speed = step_log >= n->level - 2;
+  node * r[3][3];
+  node * sq[3][3] = {{n00, n01, n02}, {n10, n11, n12}, {n20, n21, n22}};
+  for (int y = 0; y < 3; ++y)
+    for (int x = 0; x < 3; ++x)
+      r[y][x] = full_speed ? result(sq[y][x]) : centre(sq[y][x]);
+
+  return n->result = find_node(
+    result(find_node(r[0][0], r[0][1], r[1][0], r[1][1])),
+    result(find_node(r[0][1], r[0][2], r[1][1], r[1][2])),
+    result(find_node(r[1][0], r[1][1], r[2][0], r[2][1])),
+    result(find_node(r[1][1], r[1][2], r[2][1], r[2][2])));
+}
+
+/* the same square with an empty border around it, one level up */
+static node * expand(node * n) {
+  node * e = empty_node(n->level - 1);
+  return find_node(find_node(e, e, e, n->nw), find_node(e, e, n->ne, e),
+                   find_node(e, n->sw, e, e), find_node(n->se, e, e, e));
+}
+
+/* true when every live cell is in the centred quarter-width square */
+static bool centred(node * n) {
+  if (n->level < 3)
+    return n->population == 0;
+  uint64_t inner = n->nw->se->se->population + n->ne->sw->sw->population +
+                   n->sw->ne->ne->population + n->se->nw->nw->population;
+  return inner == n->population;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* the universe: root covers [ox, ox+2^level) x [oy, oy+2^level) */
+static node * root;
+static int64_t ox, oy;
+
+static node * build(const std::vector<unsigned char> & cells, int size, int level, int64_t x0, int64_t y0) {
+  if (x0 >= size || y0 >= size)
+    return empty_node(level);
+  if (level == 0)
+    return cells[(size_t)y0*size + x0] ? &live_leaf : &dead_leaf;
+  int64_t h = (int64_t)1 << (level - 1);
+  return find_node(build(cells, size, level-1, x0, y0), build(cells, size, level-1, x0+h, y0),
+                   build(cells, size, level-1, x0, y0+h), build(cells, size, level-1, x0+h, y0+h));
+}
+
+static void grow() {
+  int64_t quarter = (int64_t)1 << (root->level - 1);
+  root = expand(root);
+  ox -= quarter;
+  oy -= quarter;
+}
+
+/* advances the universe by 2^log generations */
+static void advance(int log) {
+  set_step(log);
+  while (root->level < log + 3 || !centred(root))
+    grow();
+  int64_t quarter = (int64_t)1 << (root->level - 2);
+  root = result(root);
+  ox += quarter;
+  oy += quarter;
+  if (used_bytes() > max_bytes)
+    collect(root);
+}
+
+/* copies the cells of n that fall inside [0, size)^2 */
+static void rasterize(node * n, int64_t x0, int64_t y0, std::vector<unsigned char> & cells, int size,
+                      uint64_t * inside) {
+  int64_t side = (int64_t)1 << n->level;
+  if (n->population == 0 || x0 >= size || y0 >= size || x0 + side <= 0 || y0 + side <= 0)
+    return;
+  if (n->level == 0) {
+    cells[(size_t)y0*size + x0] = 1;
+    (*inside)++;
+    return;
+  }
+  int64_t h = side / 2;
+  rasterize(n->nw, x0, y0, cells, size, inside);
+  rasterize(n->ne, x0+h, y0, cells, size, inside);
+  rasterize(n->sw, x0, y0+h, cells, size, inside);
+  rasterize(n->se, x0+h, y0+h, cells, size, inside);
+}
+
+/* print the life board */
+void print (const std::vector<unsigned char> & cells, int size) {
+  output_t out;
+  int	j;
+  output_begin(&out, size);
+  for (j=0; j<size; j++)
+    output_cells(&out, &cells[(size_t)j*size], 1);
+  output_end(&out);
+}
+
+/* hands the board to the snapshot writer when a snapshot is due */
+void snapshot (snapshots_t * snapshots, std::vector<unsigned char> & cells, int size, long long generation) {
+  uint64_t * words = snapshot_take(snapshots, generation);
+  uint64_t inside = 0;
+  if (!words)
+    return;
+  std::fill(cells.begin(), cells.end(), 0);
+  rasterize(root, ox, oy, cells, size, &inside);
+  for (int j = 0; j < size; ++j)
+    snapshot_cells(snapshots, words, j, &cells[(size_t)j*size], 1);
+  snapshot_give(snapshots);
+}
+
+/* read a file into the life board */
+int read_file (board_text_t * text, std::vector<unsigned char> & cells, int size) {
+  return board_text_cells(text, cells.data(), size, 1);
+}
+
+// usage: ./gol-hashlife [max-megabytes] < input
+// max-megabytes caps the node cache (default 1024); when a step leaves it
+// bigger than that, every node not reachable from the board or from the
+// results of the nodes kept is freed, and if that is not enough the results
+// go too. A step can go over the cap while it runs; a board that does not
+// fit on its own stops the run
+int main(int argc, char**argv){
+  int size;
+  long long steps;
+  max_bytes = (size_t)(argc > 1 ? std::atol(argv[1]) : 1024) << 20;
+  board_text_t text;
+  if (board_text_open(stdin, &text))
+    return 1;
+  size = text.size;
+  steps = text.steps;
+  std::vector<unsigned char> cells((size_t)size*size, 0);
+  if (read_file (&text, cells, size))
+    return 1;
+  board_text_close(&text);
+
+  int level = 1;
+  while (((int64_t)1 << level) < size)
+    level++;
+  root = build(cells, size, level, 0, 0);
+  ox = oy = 0;
+
+  /* with snapshots, the steps stop at every generation one is due */
+  snapshots_t * snapshots = snapshots_start(size, steps);
+  long long generation = 0;
+  snapshot(snapshots, cells, size, 0);
+  while (generation < steps) {
+    long long target = snapshots ? std::min(steps, snapshots->next) : steps;
+    for (int log = 0; (target - generation) >> log; ++log)
+      if (((target - generation) >> log) & 1)
+        advance(log);
+    generation = target;
+    snapshot(snapshots, cells, size, generation);
+  }
+  snapshots_finish(snapshots);
+
+  std::fill(cells.begin(), cells.end(), 0);
+  uint64_t inside = 0;
+  rasterize(root, ox, oy, cells, size, &inside);
+  if (inside != root->population)
+    fprintf(stderr, "warning: %llu live cells left the board\n",
+            (unsigned long long)(root->population - inside));
+  output_title("Final:\n");
+  print(cells, size);
+}
@@ -11,11 +11,18 @@
 * The game plays a number of steps (given by the input), printing to the screen each time.  'x' printed
 * means on, space means off.
 *
+* The simulation runs on its own thread and hands every generation to the
+* main thread through frames.h. The main thread draws the newest one
+* GOL_FPS times a second (default 60), putting only the pixels of the
+* changed tiles that differ from what is on the screen.
+*
 */
 #include <stdio.h>
 #include <stdlib.h>
 #include "./array_list.h"
-#include <time.h>
+#include "./generator.h"
+#include "./frames.h"
+#include <thread>
 #include <graphics.h>
 #include "SDL/SDL.h"
 #include<X11/Xlib.h>
@@ -52,7 +59,7 @@ int adjacent_to (cell_t ** board, int size, int i, int j) {
   return count;
 }
 
-void play (cell_t ** board, cell_t ** newboard, int size, structures::ArrayList<std::pair<int,int>>* old_live_cells, structures::ArrayList<std::pair<int,int>>* new_live_cells, int iteration) {
+void play (cell_t ** board, cell_t ** newboard, int size, structures::ArrayList<std::pair<int,int>>* old_live_cells, structures::ArrayList<std::pair<int,int>>* new_live_cells, frames_t * frames) {
   int	pos, i, j, a;
   /* for each cell, apply the rules of Life */
   new_live_cells->clear();
@@ -64,12 +71,7 @@ void play (cell_t ** board, cell_t ** newboard, int size, structures::ArrayList<
     else if (a < 2) newboard[i][j] = 0;
     else newboard[i][j] = 0;
     if (board[i][j] != newboard[i][j]){
-       if (newboard[i][j]){
-          putpixel(i, j, WHITE);
-       }else{
-          putpixel(i, j, BLACK);
-       }
-
+       frame_cell(frames, i-1, j-1, newboard[i][j]);
     }
   }
 }
@@ -93,12 +95,12 @@ void print (cell_t ** board, int size) {
 
 void fill_board(cell_t ** board, int size) {
   int	i, j;
-  srand(time(NULL));
+  uint64_t seed = board_seed();
   /* for each row */
   for (j=1; j<size+1; j++) {
     /* print each column position... */
     for (i=1; i<size+1; i++)
-	    board[i][j] = (int)(rand()) & 1;
+	    board[i][j] = random_cell(seed, i-1, j-1, 0.5);
     /* followed by a carriage return */
     printf ("\n");
   }
@@ -116,7 +118,6 @@ int main(int argc, char**argv){
   fill_board(prev, size);
   cell_t ** next = allocate_board (size+2);
   cell_t ** tmp;
-  int i;
   //print(prev,size);
   auto old_live_cells = new structures::ArrayList<std::pair<int,int>>{size*size};
   auto new_live_cells = new structures::ArrayList<std::pair<int,int>>{size*size};
@@ -126,17 +127,56 @@ int main(int argc, char**argv){
       old_live_cells->push_back(std::pair<int,int>{i,j});
     }
   }
-  for (i=0; i<steps; i++) {
-    play (prev,next,size,  old_live_cells, new_live_cells, i);
-    tmp = next;
-    next = prev;
-    prev = tmp;
-    temp = old_live_cells;
-    old_live_cells = new_live_cells;
-    new_live_cells = temp;
-    //delay(13);
-    //cleardevice();
+  /* generation 0; the screen starts black */
+  frames_t frames;
+  frames_init(&frames, size);
+  for (int j = 1; j<size+1; ++j){
+    for (int i = 1; i<size+1; ++i){
+      frame_cell(&frames, i-1, j-1, prev[i][j]);
+    }
+  }
+  frames_publish(&frames);
+
+  std::thread simulation([&]() {
+    for (int i=0; i<steps; i++) {
+      frames.sim.generation = i + 1;
+      play (prev,next,size,  old_live_cells, new_live_cells, &frames);
+      tmp = next;
+      next = prev;
+      prev = tmp;
+      temp = old_live_cells;
+      old_live_cells = new_live_cells;
+      new_live_cells = temp;
+      frames_publish(&frames);
+    }
+    frames.done = true;
+  });
+
+  const char * fps = getenv("GOL_FPS");
+  int period = fps && atoi(fps) <= 0 ? 0 : 1000 / (fps ? atoi(fps) : 60);
+  std::vector<unsigned char> screen((size_t)size * size, 0);
+  for (;;) {
+    bool done = frames.done;
+    frame_t * frame = frames_latest(&frames);
+    if (frame) {
+      frame_changes(&frames, frame, [&](int x, int y, int w, int h) {
+        for (int b = y; b < y + h; b++) {
+          for (int a = x; a < x + w; a++) {
+            unsigned char cell = frame->pixels[(size_t)b * size + a];
+            if (cell != screen[(size_t)b * size + a]) {
+              screen[(size_t)b * size + a] = cell;
+              putpixel(a + 1, b + 1, cell ? WHITE : BLACK);
+            }
+          }
+        }
+      });
+    } else if (done) {
+      break;
+    }
+    if (period)
+      delay(period);
   }
+  simulation.join();
   getch();
   closegraph();
   //printf("Final:\n");
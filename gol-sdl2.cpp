@@ -11,17 +11,41 @@
 * The game plays a number of steps (given by the input), printing to the screen each time.  'x' printed
 * means on, space means off.
 *
+* The simulation runs on its own thread and hands every generation to the
+* renderer through frames.h, so it is not held back by the display. The
+* renderer takes the newest generation GOL_FPS times a second (default 60,
+* 0 for as often as it can) and skips the ones in between.
+*
+* The window (GOL_WINDOW=WIDTHxHEIGHT, default 720x720, resizable) is a
+* view of the board, see viewport.h: it starts zoomed out until the board
+* fits, the arrow keys move it, + and - or the wheel zoom. The texture is
+* the size of the window, one byte per texel (RGB332: a live cell is 0xff,
+* white, a dead one 0, black, and a block of cells is grey as it fills).
+* Every frame only the texels over the 32x32 tiles that changed since the
+* last one are drawn and uploaded, a run of neighbouring tiles in a row per
+* rectangle. To time the frames without a display, run it on SDL's
+* offscreen or dummy video driver:
+*
+*   SDL_VIDEODRIVER=offscreen ./gol-sdl2 2000 500 3
+*
+* The frame times go to stderr at the end. With GOL_HOLD=1 the window stays
+* open after the last generation, until it is closed.
+*
 */
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_render.h>
 #include <iostream>
 #include <vector>
+#include <algorithm>
 #include <stdio.h>
 #include <stdlib.h>
 #include "./array_list.h"
-#include <time.h>
+#include "./generator.h"
 #include <cassert>
+#include <thread>
+#include "./frames.h"
+#include "./viewport.h"
 
 
 using namespace std;
@@ -70,28 +94,13 @@ inline void copy_borders(cell_t** board, int size){
 }
 
 void play (cell_t ** board, cell_t ** newboard, int size, structures::ArrayList<std::pair<int,int>>* old_live_cells
-  , structures::ArrayList<std::pair<int,int>>* new_live_cells, vector<unsigned char>* pixels) {
+  , structures::ArrayList<std::pair<int,int>>* new_live_cells, frames_t * frames) {
   int	pos, i, j, a, changed = 0;
   /* for each cell, apply the rules of Life */
   new_live_cells->clear();
   for (i=1; i<size+1; i++){
     for (j=1; j<size+1; j++) {
-      newboard[i][j] = next_state[board[i][j]];/*
-      if (board[i][j] != newboard[i][j]){
-         if (newboard[i][j] >> 4){
-           const unsigned int offset = ( (size+2) * 4 * j ) + i * 4;
-           pixels->at(offset ) = 255;        // b
-           pixels->at(offset + 1) =  255;        // g
-           pixels->at(offset + 2) =  255;        // r
-           pixels->at(offset + 3) = SDL_ALPHA_OPAQUE;
-         } else {
-           const unsigned int offset = ( (size+2) * 4 * j ) + i * 4;
-           pixels->at( offset) =  0;        // b
-           pixels->at( offset + 1 ) =  0;        // g
-           pixels->at( offset + 2 ) =  0;        // r
-           pixels->at( offset + 3 ) = SDL_ALPHA_OPAQUE;
-         }
-      }*/
+      newboard[i][j] = next_state[board[i][j]];
     }
   }
   for (i=1; i<size+1; i++){
@@ -101,6 +110,7 @@ void play (cell_t ** board, cell_t ** newboard, int size, structures::ArrayList<
       //assert(newboard[i][j] < 32);
         if (board[i][j]>>4 != nb){
           changed++;
+          frame_cell(frames, i-1, j-1, nb);
             if(nb){
               newboard[i-1][j-1] += 1;
               newboard[i-1][j] += 1;
@@ -131,10 +141,10 @@ void play (cell_t ** board, cell_t ** newboard, int size, structures::ArrayList<
 
 void fill_board(cell_t ** board, int size, int percentage_alive) {
   int	i, j;
-  srand(time(NULL));
+  uint64_t seed = board_seed();
   for (j=1; j<size+1; j++) {
     for (i=1; i<size+1; i++){
-	    board[i][j] = ((int)(rand()) %percentage_alive == 0? 1 : 0 )<< 4;
+	    board[i][j] = random_cell(seed, i-1, j-1, 1.0/percentage_alive) << 4;
     }
   }
   for (j=1; j<size+1; j++) {
@@ -239,7 +249,6 @@ int main(int argc, char**argv){
   fill_board(prev, size, dead);
   cell_t ** next = allocate_board (size+2);
   cell_t ** tmp;
-  int i;
   //print(prev,size);
   auto old_live_cells = new structures::ArrayList<std::pair<int,int>>{(size_t)size*size};
   auto new_live_cells = new structures::ArrayList<std::pair<int,int>>{(size_t)size*size};
@@ -251,82 +260,178 @@ int main(int argc, char**argv){
   }
 
 
-  const unsigned int texWidth = size+2;
-  const unsigned int texHeight = size+2;
-
-/*
-  SDL_Init( SDL_INIT_EVERYTHING );
+  SDL_Init( SDL_INIT_VIDEO );
   atexit( SDL_Quit );
 
+  view_t view;
+  const char * geometry = getenv("GOL_WINDOW");
+  if (!geometry || sscanf(geometry, "%dx%d", &view.width, &view.height) != 2
+      || view.width <= 0 || view.height <= 0)
+    view.width = view.height = 720;
+
   SDL_Window* window = SDL_CreateWindow      (      "SDL2",      SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
-      size>720?720:720, size>720?720:720,      SDL_WINDOW_SHOWN      );
-
-  SDL_Renderer* renderer = SDL_CreateRenderer
-      (
-      window,
-      -1,
-      SDL_RENDERER_ACCELERATED
-      );
-
-  SDL_RendererInfo info;
-  SDL_GetRendererInfo( renderer, &info );
-  //cout << "Renderer name: " << info.name << endl;
-  //cout << "Texture formats: " << endl;
-  for( Uint32 i = 0; i < info.num_texture_formats; i++ )  {
-      //cout << SDL_GetPixelFormatName( info.texture_formats[i] ) << endl;
+      view.width, view.height,      SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE      );
+  if (!window) {
+    fprintf(stderr, "SDL_CreateWindow: %s\n", SDL_GetError());
+    return 1;
   }
-  SDL_Texture* texture = SDL_CreateTexture (      renderer,      SDL_PIXELFORMAT_ARGB8888,
-          SDL_TEXTUREACCESS_STREAMING,      texWidth, texHeight      );
 
+  /* the offscreen and dummy drivers may only have the software renderer */
+  SDL_Renderer* renderer = SDL_CreateRenderer      (      window,      -1,      SDL_RENDERER_ACCELERATED      );
+  if (!renderer)
+    renderer = SDL_CreateRenderer( window, -1, SDL_RENDERER_SOFTWARE );
+  if (!renderer) {
+    fprintf(stderr, "SDL_CreateRenderer: %s\n", SDL_GetError());
+    return 1;
+  }
 
+  /* never larger than the window, whatever the size of the board */
+  SDL_Texture* texture = SDL_CreateTexture (      renderer,      SDL_PIXELFORMAT_RGB332,
+          SDL_TEXTUREACCESS_STREAMING,      view.width, view.height      );
+  if (!texture) {
+    fprintf(stderr, "SDL_CreateTexture: %s\n", SDL_GetError());
+    return 1;
+  }
 
-  SDL_Event event;*/
+  SDL_Event event;
 
   init_states_table();
   bool running = true;
 
-  vector< unsigned char > pixels( texWidth * texHeight * 4, 0 );
-
-  for (i=0; i<steps&&running; i++) {
-      /*const Uint64 start = SDL_GetPerformanceCounter();
-
-      SDL_SetRenderDrawColor( renderer, 0, 0, 0, SDL_ALPHA_OPAQUE );
-      SDL_RenderClear( renderer );
+  pyramid_t pyramid;
+  pyramid_init(&pyramid, size);
+  view.texels.assign((size_t)view.width * view.height, 0);
+  view_fit(&view, &pyramid);
+
+  /* generation 0, which uploads every tile */
+  frames_t frames;
+  frames_init(&frames, size);
+  for (int j = 1; j<size+1; ++j){
+    for (int i = 1; i<size+1; ++i){
+      frame_cell(&frames, i-1, j-1, prev[i][j] >> 4);
+    }
+  }
+  frames_publish(&frames);
 
+  std::thread simulation([&]() {
+    for (int i=0; i<steps && !frames.stop; i++) {
+        frames.sim.generation = i + 1;
+        play (prev,next,size,  old_live_cells, new_live_cells, &frames);
+        tmp = next;
+        next = prev;
+        prev = tmp;
+        temp = old_live_cells;
+        old_live_cells = new_live_cells;
+        new_live_cells = temp;
+        frames_publish(&frames);
+    }
+    frames.done = true;
+  });
+
+  const char * fps = getenv("GOL_FPS");
+  const char * hold = getenv("GOL_HOLD");
+  const static Uint64 freq = SDL_GetPerformanceFrequency();
+  const Uint64 period = fps && atoi(fps) <= 0 ? 0 : freq / (fps ? atoi(fps) : 60);
+  const Uint64 begin = SDL_GetPerformanceCounter();
+  Uint64 tick = begin;
+  double frame_seconds = 0;
+  long long rects = 0, bytes = 0;
+  int shown = 0;
+  bool moved = true;
+  auto upload = [&](int x, int y, int w, int h) {
+    SDL_Rect rect = {x, y, w, h};
+    SDL_UpdateTexture(texture, &rect, &view.texels[(size_t)y * view.width + x], view.width);
+    rects++;
+    bytes += (long long)w * h;
+  };
+  while (running) {
       while( SDL_PollEvent( &event ) )      {
           if( ( SDL_QUIT == event.type ) ||
               ( SDL_KEYDOWN == event.type && SDL_SCANCODE_ESCAPE == event.key.keysym.scancode ) )          {
               running = false;
               break;
           }
+          if (SDL_KEYDOWN == event.type) {
+            switch (event.key.keysym.sym) {
+              case SDLK_LEFT: view_pan(&view, -view.width / 8, 0); break;
+              case SDLK_RIGHT: view_pan(&view, view.width / 8, 0); break;
+              case SDLK_UP: view_pan(&view, 0, -view.height / 8); break;
+              case SDLK_DOWN: view_pan(&view, 0, view.height / 8); break;
+              case SDLK_PLUS: case SDLK_EQUALS: case SDLK_KP_PLUS: view_zoom(&view, &pyramid, -1); break;
+              case SDLK_MINUS: case SDLK_KP_MINUS: view_zoom(&view, &pyramid, 1); break;
+              default: continue;
+            }
+            moved = true;
+          } else if (SDL_MOUSEWHEEL == event.type && event.wheel.y) {
+            view_zoom(&view, &pyramid, event.wheel.y > 0 ? -1 : 1);
+            moved = true;
+          } else if (SDL_WINDOWEVENT == event.type && SDL_WINDOWEVENT_SIZE_CHANGED == event.window.event) {
+            view.width = event.window.data1;
+            view.height = event.window.data2;
+            view.texels.assign((size_t)view.width * view.height, 0);
+            SDL_DestroyTexture( texture );
+            texture = SDL_CreateTexture( renderer, SDL_PIXELFORMAT_RGB332, SDL_TEXTUREACCESS_STREAMING,
+                                         view.width, view.height );
+            moved = true;
+          }
       }
-      SDL_Delay(100);*/
 
-        play (prev,next,size,  old_live_cells, new_live_cells, &pixels);
-        tmp = next;
-        next = prev;
-        prev = tmp;
-        temp = old_live_cells;
-        old_live_cells = new_live_cells;
-        new_live_cells = temp;
-
-    /*  SDL_UpdateTexture(texture, NULL,&pixels[0],texWidth * 4);
-      SDL_RenderCopy( renderer, texture, NULL, NULL );
-      SDL_RenderPresent( renderer );
+      /* done is read first, so the last generation is never missed */
+      bool done = frames.done;
+      frame_t * frame = frames_latest(&frames);
+      if (frame || moved) {
+        const Uint64 start = SDL_GetPerformanceCounter();
+        if (frame) {
+          frame_changes(&frames, frame, [&](int x, int y, int w, int h) {
+            pyramid_update(&pyramid, &frame->pixels[0], x, y, w, h);
+            if (!moved)
+              view_draw(&view, &pyramid, x, y, w, h, upload);
+          });
+        }
+        if (moved)
+          view_draw(&view, &pyramid, 0, 0, 0, 0, upload);
+        moved = false;
+        /* zoomed in, the renderer scales the cells up */
+        SDL_Rect source = {0, 0, view_columns(&view), view_rows(&view)};
+        SDL_Rect target = source;
+        if (view.level < 0) {
+          target.w <<= -view.level;
+          target.h <<= -view.level;
+        }
+        SDL_RenderClear( renderer );
+        SDL_RenderCopy( renderer, texture, &source, &target );
+        SDL_RenderPresent( renderer );
+        frame_seconds += ( SDL_GetPerformanceCounter() - start ) / static_cast< double >( freq );
+        shown++;
+      } else if (done && !(hold && atoi(hold))) {
+        break;
+      }
 
-      const Uint64 end = SDL_GetPerformanceCounter();
-      const static Uint64 freq = SDL_GetPerformanceFrequency();
-      const double seconds = ( end - start ) / static_cast< double >( freq );
-      //cout << "Frame time: " << seconds * 1000.0 << "ms" << endl;*/
+      tick += period;
+      const Uint64 now = SDL_GetPerformanceCounter();
+      if (tick > now)
+        SDL_Delay((Uint32)((tick - now) * 1000 / freq));
+      else
+        tick = now;
+  }
+  frames.stop = true;
+  simulation.join();
+
+  const double seconds = ( SDL_GetPerformanceCounter() - begin ) / static_cast< double >( freq );
+  fprintf(stderr, "%lld generations in %.3f s (%.1f per second), %d frames shown\n",
+          frames.published - 1, seconds, (frames.published - 1) / seconds, shown);
+  if (shown) {
+    fprintf(stderr, "%.3f ms per frame, %.1f rectangles and %.0f bytes uploaded per frame\n",
+            1000.0 * frame_seconds / shown, (double)rects / shown, (double)bytes / shown);
   }
 
-  free_board(prev,size);
-  free_board(next,size);
-
-  //SDL_DestroyRenderer( renderer );
-  //SDL_DestroyWindow( window );
-  //SDL_Quit();
-        // splat down some random pixels
-
+  free_board(prev,size+2);
+  free_board(next,size+2);
+  delete old_live_cells;
+  delete new_live_cells;
 
+  SDL_DestroyTexture( texture );
+  SDL_DestroyRenderer( renderer );
+  SDL_DestroyWindow( window );
+  return 0;
 }
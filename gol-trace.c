@@ -0,0 +1,74 @@
+/*
+* Reads the traces the engines write with GOL_TRACE (see trace.h).
+*
+* Given only the trace it prints what is in it: the board size, the frames
+* and how small they are next to one bit per cell. Given a generation it
+* writes the board at that generation as an input in any of the formats of
+* patterns.h, so a run can be resumed from any point of its history.
+*
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "./trace.h"
+#include "./patterns.h"
+
+static void summary (trace_reader_t * r) {
+  trace_frame_t frame;
+  int64_t offset;
+  long long frames = 0, deltas = 0, packed = 0, first = -1, last = -1;
+  for (offset = sizeof(r->header); offset < r->end; offset += sizeof(frame) + frame.bytes) {
+    fseeko(r->f, offset, SEEK_SET);
+    if (fread(&frame, sizeof(frame), 1, r->f) != 1)
+      break;
+    if (first < 0)
+      first = frame.generation;
+    last = frame.generation;
+    frames++;
+    deltas += frame.kind == TRACE_DELTA;
+    packed += sizeof(frame) + frame.bytes;
+  }
+  printf("size %u, %lld steps\n", r->header.size, (long long)r->header.steps);
+  printf("%lld frames, generations %lld to %lld\n", frames, first, last);
+  printf("%zu keyframes (every %u generations), %lld deltas\n", r->count, r->header.keyframe, deltas);
+  printf("%lld bytes of frames, %.2f%% of %zu bytes per frame unpacked\n", packed,
+         frames ? 100.0 * packed / ((double)frames * r->bytes) : 0.0, r->bytes);
+}
+
+// usage: ./gol-trace trace [generation [text|rle|life106|mc]]
+int main (int argc, char ** argv) {
+  trace_reader_t r;
+  FILE * f;
+  long long generation, found;
+  int format = FORMAT_RLE;
+  if (argc > 3)
+    for (format = 0; format <= FORMAT_MACROCELL; format++)
+      if (!strcmp(argv[3], format_names[format]))
+        break;
+  if (argc < 2 || argc > 4 || format > FORMAT_MACROCELL) {
+    fprintf(stderr, "usage: %s trace [generation [text|rle|life106|mc]]\n", argv[0]);
+    return 2;
+  }
+  if (!(f = fopen(argv[1], "rb"))) {
+    perror(argv[1]);
+    return 1;
+  }
+  if (trace_open(f, &r))
+    return 1;
+  if (argc == 2) {
+    summary(&r);
+  } else {
+    generation = atoll(argv[2]);
+    found = trace_seek(&r, generation);
+    if (found < 0) {
+      fprintf(stderr, "generation %lld is not in the trace\n", generation);
+      return 1;
+    }
+    if (found != generation)
+      fprintf(stderr, "generation %lld is not in the trace, writing %lld\n", generation, found);
+    write_pattern(stdout, format, r.header.size, r.header.steps - found, r.cells, r.header.words);
+  }
+  trace_close_reader(&r);
+  fclose(f);
+  return 0;
+}
@@ -7,186 +7,190 @@
 * a cell survives to the next generation, if it does not die of loneliness
 * or overcrowding
 *
-* In this version, a 2D array of ints is used.  A 1 cell is on, a 0 cell is off.
-* The game plays a number of steps (given by the input), printing to the screen each time.  'x' printed
-* means on, space means off.
+* In this version every cell keeps its state and the number of live neighbours
+* it has, and a generation only visits the cells whose neighbourhood changed in
+* the last one. A cell that changes updates the counts of its eight neighbours
+* and puts them in the change list, so the cost of a generation is proportional
+* to the number of cells that changed.
 *
 */
 #include <stdio.h>
 #include <stdlib.h>
 #include "./array_list.h"
-#include <time.h>
+#include "./board.h"
+#include "./generator.h"
+#include "./loader.h"
+#include "./output.h"
+#include "./snapshot.h"
 
-typedef unsigned char cell_t;
+/* bits of a cell: the neighbour count, the state and the in-the-list flag */
+#define COUNT 0x0f
+#define ALIVE 0x10
+#define QUEUED 0x20
 
-cell_t ** allocate_board (int size) {
-  cell_t ** board = (cell_t **) malloc(sizeof(cell_t*)*size);
-  int	i;
-  for (i=0; i<size; i++)
-  board[i] = (cell_t *) malloc(sizeof(cell_t)*size);
-  return board;
-}
+/* cells as offsets from cell (0, 0) */
+typedef structures::ArrayList<uint32_t> change_list;
 
-void free_board (cell_t ** board, int size) {
-  int     i;
-  for (i=0; i<size; i++)
-  free(board[i]);
-  free(board);
+/* the state of a cell in the next generation, indexed by state | count */
+cell_t next_state[2*ALIVE];
+
+void init_states_table(){
+  for (int i = 0; i < 9; ++i){
+    next_state[i] = i == 3 ? ALIVE : 0;
+    next_state[i | ALIVE] = i == 2 || i == 3 ? ALIVE : 0;
+  }
 }
 
+/* offsets of the eight neighbours of a cell */
+ptrdiff_t neighbours[8];
 
-/* return the number of on cells adjacent to the i,j cell */
-int adjacent_to (cell_t ** board, int size, int i, int j) {
-  int count = 0;
-  count+=board[i-1][j-1];
-  count+=board[i-1][j];
-  count+=board[i-1][j+1];
-  count+=board[i][j-1];
-  count+=board[i][j+1];
-  count+=board[i+1][j-1];
-  count+=board[i+1][j];
-  count+=board[i+1][j+1];
-  return count;
+inline void queue(board_t * board, change_list * list, ptrdiff_t pos){
+  if (!(board->cells[pos] & QUEUED)){
+    board->cells[pos] |= QUEUED;
+    list->push_back(pos);
+  }
 }
 
-void play (cell_t ** board, cell_t ** newboard, int size, structures::ArrayList<std::pair<int,int>>* old_live_cells, structures::ArrayList<std::pair<int,int>>* new_live_cells) {
-  int	pos, i, j, a;
-  /* for each cell, apply the rules of Life */
-  new_live_cells->clear();
-  for (i=1; i<size; i++)
-    for (j=1; j<size; j++) {
-      newboard[i][j] = next_state[board[i][j]];
+void play (board_t * board, change_list * old_list, change_list * new_list, change_list * changed) {
+  cell_t * cells = board->cells;
+  changed->clear();
+  new_list->clear();
+  /* decide with the counts of this generation... */
+  for (size_t k = 0; k < old_list->size(); ++k){
+    uint32_t pos = old_list->at(k);
+    cell_t c = cells[pos] &= ~QUEUED;
+    if (next_state[c] != (c & ALIVE)){
+      changed->push_back(pos);
     }
   }
-  for (i=1; i<size; i++)
-    for (j=1; j<size; j++) {
-      int nb = newboard[i][j];
-      int b = board[i][j];
-      if (nb & 0x1  != b & 0x1){//uppermost leftmost bit
-        if (nb & 0x1){
-          newboard[i-1][j-1] += 0x20000000;
-          newboard[i-1][j] += 0x02000000;
-          newboard[i][j-1] + 0x10;
-        }
-      }
-      if (nb & (0x1 <<3) != b & (0x1 <<3)){//uppermost leftmiddle bit
-        newboard[i-1][j] = newboard[i-1][j] ^ (0x1 <<3);
-      }
-      if (nb & (0x1 <<5) != b & (0x1 <<5)){//uppermost leftmiddle bit
-        newboard[i-1][j] ^= (0x1 <<5);
-      }
-      if (nb & (0x1 <<7) != b & (0x1 <<7)){//uppermost leftmiddle bit
-        if (nb & 0x1){
-            newboard[i-1][j-1] += 0x20000000;
-            newboard[i-1][j] += 0x02000000;
-            newboard[i][j-1] + 0x10;
-        }
-      }
-      if (nb & (0x1 <<10) != b & (0x1 <<10)){//uppermost leftmiddle bit
-        newboard[i-1][j] ^= (0x1 <<10);
-      }
-      if (nb & (0x1 <<12) != b & (0x1 <<12)){//uppermost leftmiddle bit
-        newboard[i-1][j] ^= (0x1 <<12);
-      }
-      if (nb & (0x1 <<14) != b & (0x1 <<14)){//uppermost leftmiddle bit
-        newboard[i-1][j] ^= (0x1 <<14);
-      }
-      if (nb & (0x1 <<16) != b & (0x1 <<16)){//uppermost leftmiddle bit
-        newboard[i-1][j] ^= (0x1 <<16);
-      }
-      if (nb & (0x1 <<18) != b & (0x1 <<18)){//uppermost leftmiddle bit
-        newboard[i-1][j] ^= (0x1 <<18);
-      }
-      if (nb & (0x1 <<20) != b & (0x1 <<20)){//uppermost leftmiddle bit
-        newboard[i-1][j] ^= (0x1 <<20);
-      }
-      if (nb & (0x1 <<22) != b & (0x1 <<22)){//uppermost leftmiddle bit
-        if (nb & 0x1){
-            newboard[i-1][j-1] += 0x20000000;
-            newboard[i-1][j] += 0x02000000;
-            newboard[i][j-1] + 0x10;
-        }
-      }
-      if (nb & (0x1 <<25) != b & (0x1 <<25)){//uppermost leftmiddle bit
-        newboard[i-1][j] ^= (0x1 <<25);
-      }
-      if (nb & (0x1 <<27) != b & (0x1 <<27)){//uppermost leftmiddle bit
-        newboard[i-1][j] ^= (0x1 <<27);
-      }
-      if (nb & (0x1 <<29) != b & (0x1 <<29)){//uppermost leftmiddle bit
-        if (nb & 0x1){
-            newboard[i-1][j-1] += 0x20000000;
-            newboard[i-1][j] += 0x02000000;
-            newboard[i][j-1] + 0x10;
-        }
-      }
+  /* ...then apply the changes and list the cells they affect */
+  for (size_t k = 0; k < changed->size(); ++k){
+    uint32_t pos = changed->at(k);
+    cell_t delta = (cells[pos] ^= ALIVE) & ALIVE ? 1 : -1;
+    queue(board, new_list, pos);
+    for (int n = 0; n < 8; ++n){
+      cells[pos + neighbours[n]] += delta;
+      queue(board, new_list, pos + neighbours[n]);
     }
   }
 }
 
-/* print the life board */
-void print (cell_t ** board, int size) {
-  int	i, j;
-  /* for each row */
-  for (j=1; j<size+1; j++) {
-    /* print each column position... */
-    for (i=1; i<size+1; i++)
-	if (board[i][j]){
-	    printf ("■ ");
-        }else{
-	    printf ("□ ");
-        }
-    /* followed by a carriage return */
-    printf ("\n");
+/* counts the neighbours of every cell and lists the ones that can change */
+void init_board (board_t * board, change_list * list) {
+  int	i, j, n;
+  int size = board->size;
+  /* the halo is never listed */
+  for (i=-1; i<size+1; i++){
+    CELL(board, -1, i) = QUEUED;
+    CELL(board, size, i) = QUEUED;
+    CELL(board, i, -1) = QUEUED;
+    CELL(board, i, size) = QUEUED;
   }
+  for (i=0; i<size; i++)
+    for (j=0; j<size; j++)
+      if (CELL(board, i, j) & ALIVE)
+        for (n = 0; n < 8; ++n)
+          (&CELL(board, i, j))[neighbours[n]]++;
+  /* a dead cell without live neighbours stays dead */
+  for (i=0; i<size; i++)
+    for (j=0; j<size; j++)
+      if (CELL(board, i, j))
+        queue(board, list, &CELL(board, i, j) - board->cells);
 }
 
-void fill_board(cell_t ** board, int size) {
+/* print the life board */
+void print (board_t * board) {
+  output_t out;
+  int	j;
+  output_begin(&out, board->size);
+  for (j=0; j<board->size; j++)
+    output_cells(&out, board_row(board, j), ALIVE);
+  output_end(&out);
+}
+
+void fill_board(board_t * board) {
   int	i, j;
-  srand(time(NULL));
-  /* for each row */
-  for (j=1; j<size+1; j++) {
-    /* print each column position... */
-    for (i=1; i<size+1; i++)
-	    board[i][j] = (int)(rand()) & 1;
-    /* followed by a carriage return */
-    printf ("\n");
-  }
+  uint64_t seed = board_seed();
+  for (j=0; j<board->size; j++)
+    for (i=0; i<board->size; i++)
+	    CELL(board, j, i) = random_cell(seed, i, j, 0.5) ? ALIVE : 0;
+}
+
+/* read a file into the life board, row j of the file in row j of the board */
+int read_file (board_text_t * text, board_t * board) {
+  return board_text_cells(text, board_row(board, 0), board->stride, ALIVE);
 }
 
+/* hands the board to the snapshot writer when a snapshot is due */
+void snapshot (snapshots_t * snapshots, board_t * board, long long generation) {
+  uint64_t * words = snapshot_take(snapshots, generation);
+  if (!words)
+    return;
+  for (int j = 0; j < board->size; ++j)
+    snapshot_cells(snapshots, words, j, board_row(board, j), ALIVE);
+  snapshot_give(snapshots);
+}
+
+// usage: ./gol < input, or ./gol size steps for a random board
 int main(int argc, char**argv){
-  int size = std::atoi(argv[1])/3;
-  int steps = std::atoi(argv[2]);
-  cell_t ** prev = allocate_board (size+2);
-  fill_board(prev, size);
-  cell_t ** next = allocate_board (size+2);
-  cell_t ** tmp;
-  int i;
-  printf("Initial:\n");
-  print(prev,size);
-  auto old_live_cells = new structures::ArrayList<std::pair<int,int>>{size*size*8};
-  auto new_live_cells = new structures::ArrayList<std::pair<int,int>>{size*size*8};
-  structures::ArrayList<std::pair<int,int>>* temp;
-  for (int i = 1; i<size+1; ++i){
-    for (int j = 1; j<size+1; ++j){
-      old_live_cells->push_back(std::pair<int,int>{i,j});
-    }
+  int size, steps;
+  board_t * board;
+  if (argc > 2){
+    size = std::atoi(argv[1]);
+    steps = std::atoi(argv[2]);
+    board = allocate_board (size);
+    fill_board(board);
+  } else {
+    board_text_t text;
+    if (board_text_open(stdin, &text))
+      return 1;
+    size = text.size;
+    steps = text.steps;
+    board = allocate_board (size);
+    if (read_file (&text, board))
+      return 1;
+    board_text_close(&text);
   }
+  if ((uint64_t)size * board->stride >= UINT32_MAX){
+    fprintf(stderr, "a board of size %d is too big for the change list\n", size);
+    return 1;
+  }
+  int i, n = 0;
+  for (int di = -1; di <= 1; ++di)
+    for (int dj = -1; dj <= 1; ++dj)
+      if (di || dj)
+        neighbours[n++] = di*board->stride + dj;
+  init_states_table();
+  #ifdef DEBUG
+  output_title("Initial:\n");
+  print(board);
+  #endif
+
+  /* every cell is listed at most once per generation */
+  /* the lists grow with the activity of the board */
+  auto old_list = new change_list{};
+  auto new_list = new change_list{};
+  auto changed = new change_list{};
+  change_list * temp;
+  init_board(board, old_list);
+  snapshots_t * snapshots = snapshots_start(size, steps);
+  snapshot(snapshots, board, 0);
   for (i=0; i<steps; i++) {
-    play (prev,next,size,  old_live_cells, new_live_cells);
+    play (board, old_list, new_list, changed);
     #ifdef DEBUG
-    printf("%d ----------\n", i + 1);
-    print (next,size);
+    output_title("%d ----------\n", i + 1);
+    print (board);
     #endif
-    tmp = next;
-    next = prev;
-    prev = tmp;
-    temp = old_live_cells;
-    old_live_cells = new_live_cells;
-    new_live_cells = temp;
+    temp = old_list;
+    old_list = new_list;
+    new_list = temp;
+    snapshot(snapshots, board, i + 1);
   }
-  printf("Final:\n");
-  print (prev,size);
-  free_board(prev,size);
-  free_board(next,size);
+  snapshots_finish(snapshots);
+  output_title("Final:\n");
+  print (board);
+  delete old_list;
+  delete new_list;
+  delete changed;
+  free_board(board);
 }
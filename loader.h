@@ -0,0 +1,455 @@
+/*
+* Parallel reader for the text boards.
+*
+* A text board is a line with "size steps" and then one line per row of the
+* board, an 'x' for every live cell. board_text_open maps the whole input
+* (or reads it, when it is a pipe), parses the header and finds where every
+* row starts: each thread counts the newlines of its slice of the file and
+* then, knowing how many lines come before the slice, records the rows that
+* start in it. board_text_cells and board_text_bits then convert the rows in
+* parallel, 32 characters per compare, straight into the rows of a board.
+*
+* Rows that are shorter than size, or missing, are dead past their end, and
+* characters past size are ignored.
+*
+* When the body after the header is an RLE, Life 1.06 or macrocell pattern
+* (see patterns.h) the same calls decode it instead, on one thread, and a
+* pattern on a pipe is streamed rather than read whole.
+*
+*/
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <immintrin.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/sysinfo.h>
+#include "patterns.h"
+
+#define LOADER_MAX_THREADS 64
+#define LOADER_SLICE (1 << 20)  /* bytes worth a thread of their own */
+
+typedef struct {
+  int size;            /* cells per side */
+  long long steps;     /* generations to play */
+  const char * text;   /* the input, header included */
+  size_t length;
+  size_t * lines;      /* lines[j] is the offset of row j, lines[size] the end */
+  void * map;          /* the mapping, or the buffer the input was read into */
+  size_t map_length;   /* 0 when map is a malloc'ed buffer */
+  int threads;
+  int format;          /* FORMAT_TEXT, or the format of the pattern */
+  pattern_in_t in;     /* the pattern, when there is one */
+} board_text_t;
+
+/* one slice of work for a loader thread */
+typedef struct {
+  const board_text_t * text;
+  int part;
+  size_t newlines;     /* phase 1: newlines in the slice; phase 2: before it */
+  void * rows;         /* cell (0, 0) of the destination */
+  ptrdiff_t stride;    /* cells (or words) between two rows */
+  unsigned char alive;
+} text_slice_t;
+
+/* runs fn on every slice, slice 0 on the calling thread */
+static inline void text_parallel (text_slice_t * slices, int n, void * (*fn)(void *)) {
+  pthread_t threads[LOADER_MAX_THREADS];
+  int k, started = 0;
+  for (k=1; k<n; k++)
+    if (!pthread_create(&threads[k], NULL, fn, &slices[k]))
+      started = k;
+    else
+      break;
+  /* whatever could not get a thread of its own runs here */
+  fn(&slices[0]);
+  for (k=started+1; k<n; k++)
+    fn(&slices[k]);
+  for (k=1; k<=started; k++)
+    pthread_join(threads[k], NULL);
+}
+
+/* [lo, hi) of part k when n is split in parts */
+static inline size_t text_split (size_t n, int parts, int k) {
+  return n / parts * k + (n % parts) * k / parts;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline void * count_newlines (void * arg) {
+  text_slice_t * slice = (text_slice_t *) arg;
+  const board_text_t * t = slice->text;
+  size_t body = t->lines[0], n = t->length - body;
+  const char * p = t->text + body + text_split(n, t->threads, slice->part);
+  const char * end = t->text + body + text_split(n, t->threads, slice->part + 1);
+  slice->newlines = 0;
+  while ((p = (const char *) memchr(p, '\n', end - p))) {
+    slice->newlines++;
+    p++;
+  }
+  return NULL;
+}
+
+static inline void * find_rows (void * arg) {
+  text_slice_t * slice = (text_slice_t *) arg;
+  const board_text_t * t = slice->text;
+  size_t body = t->lines[0], n = t->length - body;
+  size_t row = slice->newlines;
+  const char * p = t->text + body + text_split(n, t->threads, slice->part);
+  const char * end = t->text + body + text_split(n, t->threads, slice->part + 1);
+  while (row < (size_t)t->size && (p = (const char *) memchr(p, '\n', end - p))) {
+    p++;
+    t->lines[++row] = p - t->text;
+  }
+  return NULL;
+}
+
+/* reads the header and the first line of the body from a pipe */
+static inline char * read_head (FILE * f, size_t * n, size_t * capacity) {
+  char * buffer = (char *) malloc(*capacity = 1 << 16);
+  int c, lines = 0;
+  *n = 0;
+  while (buffer && lines < 2 && (c = getc_unlocked(f)) != EOF) {
+    buffer[(*n)++] = c;
+    lines += c == '\n';
+    if (*n == *capacity)
+      buffer = (char *) realloc(buffer, *capacity *= 2);
+  }
+  return buffer;
+}
+
+/* appends the rest of a pipe to the n bytes in buffer */
+static inline char * read_rest (FILE * f, char * buffer, size_t * n, size_t capacity) {
+  size_t got;
+  while (buffer && (got = fread(buffer + *n, 1, capacity - *n, f)) > 0) {
+    *n += got;
+    if (*n == capacity)
+      buffer = (char *) realloc(buffer, capacity *= 2);
+  }
+  return buffer;
+}
+
+static inline void board_text_close (board_text_t * t) {
+  if (t->map_length)
+    munmap(t->map, t->map_length);
+  else
+    free(t->map);
+  free(t->lines);
+  t->map = NULL;
+  t->lines = NULL;
+}
+
+/* maps or reads f and finds its rows; returns 0, or -1 after printing why not.
+ * For a pattern it only reads the header and leaves the rest to the
+ * conversion. */
+static inline int board_text_open (FILE * f, board_text_t * t) {
+  int fd = fileno(f);
+  struct stat st;
+  off_t start = lseek(fd, 0, SEEK_CUR);
+  const char * header_end;
+  char * end;
+  size_t k, before, capacity, body;
+  text_slice_t slices[LOADER_MAX_THREADS];
+
+  memset(t, 0, sizeof(*t));
+  if (!fstat(fd, &st) && S_ISREG(st.st_mode) && start >= 0 && st.st_size > start) {
+    t->map_length = st.st_size;
+    t->map = mmap(NULL, t->map_length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (t->map == MAP_FAILED) {
+      perror("mmap");
+      return -1;
+    }
+    madvise(t->map, t->map_length, MADV_WILLNEED);
+    t->text = (const char *) t->map + start;
+    t->length = st.st_size - start;
+  } else {
+    char * buffer = read_head(f, &t->length, &capacity);
+    const char * line = buffer ? (const char *) memchr(buffer, '\n', t->length) : NULL;
+    /* a dense grid is read whole, a pattern is streamed */
+    if (buffer && (!line || pattern_format(line + 1, buffer + t->length - line - 1) == FORMAT_TEXT))
+      buffer = read_rest(f, buffer, &t->length, capacity);
+    t->map = buffer;
+    t->text = buffer;
+  }
+  if (!t->text) {
+    fprintf(stderr, "out of memory reading the board\n");
+    return -1;
+  }
+
+  /* the header ends at the first newline; the text is not terminated, so
+   * parse a copy of it */
+  header_end = (const char *) memchr(t->text, '\n', t->length);
+  k = header_end ? (size_t)(header_end - t->text) : t->length;
+  char header[64] = {0};
+  memcpy(header, t->text, k < sizeof(header) - 1 ? k : sizeof(header) - 1);
+  t->size = strtol(header, &end, 10);
+  t->steps = strtoll(end, &end, 10);
+  if (t->size <= 0 || end == header) {
+    fprintf(stderr, "the board must start with its size and the number of generations\n");
+    board_text_close(t);
+    return -1;
+  }
+  body = header_end ? k + 1 : t->length;
+  t->format = pattern_format(t->text + body, t->length - body);
+  if (t->format != FORMAT_TEXT) {
+    t->in.p = t->text + body;
+    t->in.end = t->text + t->length;
+    t->in.f = t->map_length ? NULL : f;
+    t->in.size = t->size;
+    return 0;
+  }
+  t->lines = (size_t *) malloc((t->size + 1) * sizeof(size_t));
+  t->lines[0] = body;
+
+  t->threads = 1 + (int)((t->length - t->lines[0]) / LOADER_SLICE);
+  if (t->threads > get_nprocs())
+    t->threads = get_nprocs();
+  if (t->threads > LOADER_MAX_THREADS)
+    t->threads = LOADER_MAX_THREADS;
+  for (k=0; k<(size_t)t->threads; k++) {
+    slices[k].text = t;
+    slices[k].part = k;
+  }
+  text_parallel(slices, t->threads, count_newlines);
+  for (k=0, before=0; k<(size_t)t->threads; k++) {
+    size_t in_slice = slices[k].newlines;
+    slices[k].newlines = before;
+    before += in_slice;
+  }
+  text_parallel(slices, t->threads, find_rows);
+  /* a last row without a newline ends at the end of the input; the rows
+   * after it are empty */
+  for (k=before+1; k<=(size_t)t->size; k++)
+    t->lines[k] = t->length;
+  return 0;
+}
+
+/* returns row j and puts in *n how many of its characters are cells; only
+ * for FORMAT_TEXT */
+static inline const char * board_text_row (const board_text_t * t, int j, int * n) {
+  size_t start = t->lines[j], end = t->lines[j+1];
+  if (end > start && t->text[end-1] == '\n')
+    end--;
+  if (end > start && t->text[end-1] == '\r')
+    end--;
+  *n = end - start < (size_t)t->size ? (int)(end - start) : t->size;
+  return t->text + start;
+}
+
+/* ------------------------------------------------------------------------- */
+/* one byte per cell: alive or 0 */
+
+static inline void text_cells_scalar (const char * s, int n, unsigned char * out,
+                                      unsigned char alive) {
+  int j;
+  for (j=0; j<n; j++)
+    out[j] = s[j] == 'x' ? alive : 0;
+}
+
+__attribute__((target("sse2")))
+static inline void text_cells_sse2 (const char * s, int n, unsigned char * out,
+                                    unsigned char alive) {
+  const __m128i x = _mm_set1_epi8('x');
+  const __m128i a = _mm_set1_epi8(alive);
+  int j;
+  for (j=0; j+16<=n; j+=16) {
+    __m128i c = _mm_loadu_si128((const __m128i *)(s+j));
+    _mm_storeu_si128((__m128i *)(out+j), _mm_and_si128(_mm_cmpeq_epi8(c, x), a));
+  }
+  text_cells_scalar(s+j, n-j, out+j, alive);
+}
+
+__attribute__((target("avx2")))
+static inline void text_cells_avx2 (const char * s, int n, unsigned char * out,
+                                    unsigned char alive) {
+  const __m256i x = _mm256_set1_epi8('x');
+  const __m256i a = _mm256_set1_epi8(alive);
+  int j;
+  for (j=0; j+32<=n; j+=32) {
+    __m256i c = _mm256_loadu_si256((const __m256i *)(s+j));
+    _mm256_storeu_si256((__m256i *)(out+j), _mm256_and_si256(_mm256_cmpeq_epi8(c, x), a));
+  }
+  text_cells_sse2(s+j, n-j, out+j, alive);
+}
+
+/* ------------------------------------------------------------------------- */
+/* one bit per cell, cell i in bit i%64 of word i/64 */
+
+static inline uint64_t text_word_scalar (const char * s, int n) {
+  uint64_t w = 0;
+  int j;
+  for (j=0; j<n; j++)
+    w |= (uint64_t)(s[j] == 'x') << j;
+  return w;
+}
+
+__attribute__((target("sse2")))
+static inline void text_bits_sse2 (const char * s, int n, uint64_t * out, int words) {
+  const __m128i x = _mm_set1_epi8('x');
+  int w, k;
+  for (w=0; w<words; w++, s+=64, n-=64) {
+    if (n < 64) {
+      out[w] = n > 0 ? text_word_scalar(s, n) : 0;
+      continue;
+    }
+    uint64_t bits = 0;
+    for (k=0; k<4; k++) {
+      __m128i c = _mm_loadu_si128((const __m128i *)(s+16*k));
+      bits |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(c, x)) << 16*k;
+    }
+    out[w] = bits;
+  }
+}
+
+__attribute__((target("avx2")))
+static inline void text_bits_avx2 (const char * s, int n, uint64_t * out, int words) {
+  const __m256i x = _mm256_set1_epi8('x');
+  int w;
+  for (w=0; w<words; w++, s+=64, n-=64) {
+    if (n < 64) {
+      out[w] = n > 0 ? text_word_scalar(s, n) : 0;
+      continue;
+    }
+    __m256i lo = _mm256_loadu_si256((const __m256i *)s);
+    __m256i hi = _mm256_loadu_si256((const __m256i *)(s+32));
+    out[w] = (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, x)) |
+             (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, x)) << 32;
+  }
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline void * convert_cells (void * arg) {
+  text_slice_t * slice = (text_slice_t *) arg;
+  const board_text_t * t = slice->text;
+  int j, n;
+  int lo = text_split(t->size, t->threads, slice->part);
+  int hi = text_split(t->size, t->threads, slice->part + 1);
+  void (*convert)(const char *, int, unsigned char *, unsigned char) =
+      __builtin_cpu_supports("avx2") ? text_cells_avx2 : text_cells_sse2;
+  for (j=lo; j<hi; j++) {
+    const char * s = board_text_row(t, j, &n);
+    unsigned char * out = (unsigned char *) slice->rows + (ptrdiff_t)j*slice->stride;
+    convert(s, n, out, slice->alive);
+    memset(out + n, 0, t->size - n);
+  }
+  return NULL;
+}
+
+static inline void * convert_bits (void * arg) {
+  text_slice_t * slice = (text_slice_t *) arg;
+  const board_text_t * t = slice->text;
+  int j, n;
+  int lo = text_split(t->size, t->threads, slice->part);
+  int hi = text_split(t->size, t->threads, slice->part + 1);
+  int words = (t->size + 63) / 64;
+  void (*convert)(const char *, int, uint64_t *, int) =
+      __builtin_cpu_supports("avx2") ? text_bits_avx2 : text_bits_sse2;
+  for (j=lo; j<hi; j++) {
+    const char * s = board_text_row(t, j, &n);
+    convert(s, n, (uint64_t *) slice->rows + (ptrdiff_t)j*slice->stride, words);
+  }
+  return NULL;
+}
+
+static inline void convert_rows (const board_text_t * t, void * rows, ptrdiff_t stride,
+                                 unsigned char alive, void * (*fn)(void *)) {
+  text_slice_t slices[LOADER_MAX_THREADS];
+  int k;
+  __builtin_cpu_init();
+  for (k=0; k<t->threads; k++) {
+    slices[k].text = t;
+    slices[k].part = k;
+    slices[k].rows = rows;
+    slices[k].stride = stride;
+    slices[k].alive = alive;
+  }
+  text_parallel(slices, t->threads, fn);
+}
+
+/* ------------------------------------------------------------------------- */
+/* patterns: clear the rows, then set the runs the decoder finds */
+
+static inline void set_cells (void * ctx, int x, int y, int n) {
+  text_slice_t * slice = (text_slice_t *) ctx;
+  memset((unsigned char *) slice->rows + (ptrdiff_t)y*slice->stride + x, slice->alive, n);
+}
+
+static inline void set_bits (void * ctx, int x, int y, int n) {
+  text_slice_t * slice = (text_slice_t *) ctx;
+  uint64_t * row = (uint64_t *) slice->rows + (ptrdiff_t)y*slice->stride;
+  while (n > 0) {
+    int b = x % 64, k = n < 64 - b ? n : 64 - b;
+    row[x/64] |= (k == 64 ? ~(uint64_t)0 : ((uint64_t)1 << k) - 1) << b;
+    x += k;
+    n -= k;
+  }
+}
+
+/* stride counts elements of the row, of elem bytes each */
+static inline int decode_rows (board_text_t * t, void * rows, ptrdiff_t stride, size_t elem,
+                               size_t row_bytes, unsigned char alive, run_t run) {
+  text_slice_t slice;
+  int j;
+  for (j=0; j<t->size; j++)
+    memset((char *) rows + (ptrdiff_t)j*stride*elem, 0, row_bytes);
+  slice.text = t;
+  slice.rows = rows;
+  slice.stride = stride;
+  slice.alive = alive;
+  t->in.run = run;
+  t->in.ctx = &slice;
+  return read_pattern(&t->in, t->format);
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* row j of the board goes to rows + j*stride, one byte per cell, alive or 0;
+ * returns 0, or -1 after printing why the pattern could not be read */
+static inline int board_text_cells (board_text_t * t, unsigned char * rows, ptrdiff_t stride,
+                                    unsigned char alive) {
+  if (t->format != FORMAT_TEXT)
+    return decode_rows(t, rows, stride, 1, t->size, alive, set_cells);
+  convert_rows(t, rows, stride, alive, convert_cells);
+  return 0;
+}
+
+/* row j of the board goes to rows + j*stride, one bit per cell; the words
+ * past the last cell of a row are zeroed */
+static inline int board_text_bits (board_text_t * t, uint64_t * rows, ptrdiff_t stride) {
+  if (t->format != FORMAT_TEXT)
+    return decode_rows(t, rows, stride, sizeof(uint64_t), (t->size + 63) / 64 * sizeof(uint64_t),
+                       0, set_bits);
+  convert_rows(t, rows, stride, 0, convert_bits);
+  return 0;
+}
+
+/* hands every run of live cells to run, for boards that are not a grid */
+static inline int board_text_runs (board_text_t * t, run_t run, void * ctx) {
+  int j, n;
+  if (t->format != FORMAT_TEXT) {
+    t->in.run = run;
+    t->in.ctx = ctx;
+    return read_pattern(&t->in, t->format);
+  }
+  for (j=0; j<t->size; j++) {
+    const char * s = board_text_row(t, j, &n);
+    const char * x = s, * e;
+    while ((x = (const char *) memchr(x, 'x', s + n - x))) {
+      for (e = x; e < s + n && *e == 'x'; e++)
+        ;
+      run(ctx, x - s, j, e - x);
+      x = e;
+    }
+  }
+  return 0;
+}
+
+#endif
@@ -0,0 +1,163 @@
+/*
+* Buffered board output.
+*
+* A frame is formatted row by row into one buffer, which goes out with a
+* single fwrite whenever it fills up and at the end of the frame, instead
+* of a printf per cell. GOL_OUTPUT picks the format:
+*
+*   text  (default) "■ " or "□ " per cell and a newline per row
+*   bits  every row as (size+7)/8 bytes, cell i in bit i%8 of byte i/8;
+*         frames follow each other with nothing in between
+*   pbm   every frame is a binary PBM (P4) image, live cells black;
+*         netpbm reads a file of them as a sequence of images
+*
+* Titles ("Final:", the generation counters) are only printed as text.
+*
+*/
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <immintrin.h>
+
+enum { OUTPUT_TEXT, OUTPUT_BITS, OUTPUT_PBM };
+
+#define OUTPUT_BUFFER (1 << 20)
+
+typedef struct {
+  int mode;
+  int size;
+  size_t row_bytes;
+  char * buffer;
+  size_t used, capacity;
+} output_t;
+
+static inline int output_mode (void) {
+  static int mode = -1;
+  const char * name;
+  if (mode >= 0)
+    return mode;
+  name = getenv("GOL_OUTPUT");
+  if (!name || !strcmp(name, "text")) {
+    mode = OUTPUT_TEXT;
+  } else if (!strcmp(name, "bits")) {
+    mode = OUTPUT_BITS;
+  } else if (!strcmp(name, "pbm")) {
+    mode = OUTPUT_PBM;
+  } else {
+    fprintf(stderr, "GOL_OUTPUT must be text, bits or pbm; printing text\n");
+    mode = OUTPUT_TEXT;
+  }
+  return mode;
+}
+
+/* printf, when the output is text */
+static inline void output_title (const char * format, ...) {
+  va_list args;
+  if (output_mode() != OUTPUT_TEXT)
+    return;
+  va_start(args, format);
+  vprintf(format, args);
+  va_end(args);
+}
+
+static inline void output_flush (output_t * out) {
+  fwrite(out->buffer, 1, out->used, stdout);
+  out->used = 0;
+}
+
+static inline void output_begin (output_t * out, int size) {
+  out->mode = output_mode();
+  out->size = size;
+  /* "■ " is four bytes of UTF-8 */
+  out->row_bytes = out->mode == OUTPUT_TEXT ? 4 * (size_t)size + 1 : ((size_t)size + 7) / 8;
+  out->capacity = out->row_bytes > OUTPUT_BUFFER ? out->row_bytes : OUTPUT_BUFFER;
+  out->buffer = (char *) malloc(out->capacity);
+  out->used = 0;
+  if (out->mode == OUTPUT_PBM)
+    out->used = sprintf(out->buffer, "P4\n%d %d\n", size, size);
+}
+
+static inline void output_end (output_t * out) {
+  output_flush(out);
+  fflush(stdout);
+  free(out->buffer);
+}
+
+/* room for the next row */
+static inline char * output_row (output_t * out) {
+  char * row;
+  if (out->used + out->row_bytes > out->capacity)
+    output_flush(out);
+  row = out->buffer + out->used;
+  out->used += out->row_bytes;
+  return row;
+}
+
+/* PBM puts the first pixel in the high bit */
+static inline unsigned char reverse_bits (unsigned char b) {
+  b = (b & 0xf0) >> 4 | (b & 0x0f) << 4;
+  b = (b & 0xcc) >> 2 | (b & 0x33) << 2;
+  return (b & 0xaa) >> 1 | (b & 0x55) << 1;
+}
+
+/* packs n cells into bytes, cell i in bit i%8, 16 cells per compare */
+__attribute__((target("sse2")))
+static inline void pack_cells (const unsigned char * cells, int n, unsigned char mask, char * row) {
+  const __m128i m = _mm_set1_epi8(mask);
+  const __m128i zero = _mm_setzero_si128();
+  int i, k;
+  for (i=0; i+16<=n; i+=16) {
+    __m128i c = _mm_and_si128(_mm_loadu_si128((const __m128i *)(cells+i)), m);
+    int bits = ~_mm_movemask_epi8(_mm_cmpeq_epi8(c, zero));
+    row[i/8] = bits;
+    row[i/8+1] = bits >> 8;
+  }
+  for (; i<n; i+=8) {
+    unsigned char b = 0;
+    for (k=0; k<8 && i+k<n; k++)
+      b |= ((cells[i+k] & mask) != 0) << k;
+    row[i/8] = b;
+  }
+}
+
+static const char output_glyphs[2][4] = {{'\xe2', '\x96', '\xa1', ' '},
+                                         {'\xe2', '\x96', '\xa0', ' '}};
+
+/* a row of one byte per cell; a cell is alive when it has a bit of mask set */
+static inline void output_cells (output_t * out, const unsigned char * cells, unsigned char mask) {
+  char * row = output_row(out);
+  int i, n = out->size;
+  if (out->mode == OUTPUT_TEXT) {
+    for (i=0; i<n; i++)
+      memcpy(row + 4*i, output_glyphs[(cells[i] & mask) != 0], 4);
+    row[4*n] = '\n';
+    return;
+  }
+  pack_cells(cells, n, mask, row);
+  if (out->mode == OUTPUT_PBM)
+    for (i=0; i<(int)out->row_bytes; i++)
+      row[i] = reverse_bits(row[i]);
+}
+
+/* a row of one bit per cell, cell i in bit i%64 of word i/64 */
+static inline void output_bits (output_t * out, const uint64_t * words) {
+  char * row = output_row(out);
+  int i, n = out->size;
+  if (out->mode == OUTPUT_TEXT) {
+    for (i=0; i<n; i++)
+      memcpy(row + 4*i, output_glyphs[(words[i/64] >> (i%64)) & 1], 4);
+    row[4*n] = '\n';
+    return;
+  }
+  for (i=0; i<(int)out->row_bytes; i++) {
+    unsigned char b = words[i/8] >> (8*(i%8));
+    row[i] = out->mode == OUTPUT_PBM ? reverse_bits(b) : b;
+  }
+}
+
+#endif
@@ -0,0 +1,534 @@
+/*
+* Pattern formats: RLE, Life 1.06 and macrocell.
+*
+* After the "size steps" line an input may hold, instead of the dense grid,
+* a pattern in one of the formats Golly and LifeWiki use:
+*
+*   RLE        "x = w, y = h" and runs like 3o2b$bo!  ('#' comment lines first)
+*   Life 1.06  "#Life 1.06" and one "x y" line per live cell
+*   macrocell  "[M2]" and a quadtree, one node per line, children first
+*
+* The plane origin is cell (size/2, size/2) of the board. Life 1.06 and
+* macrocell coordinates are relative to it. An RLE pattern is centred on
+* it, unless a "#CXRLE Pos=x,y" line puts its top left corner elsewhere.
+* Live cells that fall outside the board are dropped.
+*
+* The readers stream the input a character or a line at a time and hand
+* every horizontal run of live cells to a callback, so they never hold the
+* text. The macrocell reader keeps the nodes, which is the size of the
+* compressed pattern. The writers take the board packed one bit per cell
+* and write a complete input ("size steps" included).
+*
+*/
+#ifndef PATTERNS_H
+#define PATTERNS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+
+enum { FORMAT_TEXT, FORMAT_RLE, FORMAT_LIFE106, FORMAT_MACROCELL };
+
+static const char * format_names[] __attribute__((unused)) = {"text", "rle", "life106", "mc"};
+
+/* cells (x, y) to (x+n-1, y) are alive; the run is inside the board */
+typedef void (*run_t)(void * ctx, int x, int y, int n);
+
+typedef struct {
+  const char * p, * end;  /* bytes that come before the rest of f */
+  FILE * f;               /* the rest of the input, or NULL */
+  int size;
+  run_t run;
+  void * ctx;
+  uint64_t dropped;       /* live cells that fell outside the board */
+} pattern_in_t;
+
+/* the format of an input whose body starts with the n bytes at s */
+static inline int pattern_format (const char * s, size_t n) {
+  size_t k = 1;
+  if (n >= 10 && !memcmp(s, "#Life 1.06", 10))
+    return FORMAT_LIFE106;
+  if (n >= 4 && !memcmp(s, "[M2]", 4))
+    return FORMAT_MACROCELL;
+  if (n >= 1 && s[0] == '#')
+    return FORMAT_RLE;
+  if (n >= 1 && s[0] == 'x') {
+    while (k < n && s[k] == ' ')
+      k++;
+    if (k < n && s[k] == '=')
+      return FORMAT_RLE;
+  }
+  return FORMAT_TEXT;
+}
+
+static inline int pattern_getc (pattern_in_t * in) {
+  if (in->p < in->end)
+    return (unsigned char)*in->p++;
+  return in->f ? getc_unlocked(in->f) : EOF;
+}
+
+/* reads a line, keeping its first n-1 characters; returns EOF at the end */
+static inline int pattern_line (pattern_in_t * in, char * line, size_t n) {
+  size_t k = 0;
+  int c;
+  while ((c = pattern_getc(in)) != EOF && c != '\n')
+    if (k < n - 1 && c != '\r')
+      line[k++] = c;
+  line[k] = 0;
+  return c == EOF && k == 0 ? EOF : 0;
+}
+
+/* live cells (x, y) to (x+n-1, y), in board coordinates */
+static inline void pattern_cells (pattern_in_t * in, int64_t x, int64_t y, int64_t n) {
+  int64_t all = n;
+  if (y < 0 || y >= in->size || x >= in->size || x + n <= 0) {
+    in->dropped += all;
+    return;
+  }
+  if (x < 0) {
+    n += x;
+    x = 0;
+  }
+  if (x + n > in->size)
+    n = in->size - x;
+  in->dropped += all - n;
+  in->run(in->ctx, (int)x, (int)y, (int)n);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline int rule_is_life (const char * rule) {
+  char r[32];
+  size_t k = 0;
+  for (; *rule && *rule != ',' && k < sizeof(r) - 1; rule++)
+    if (!isspace((unsigned char)*rule))
+      r[k++] = toupper((unsigned char)*rule);
+  r[k] = 0;
+  return !strcmp(r, "B3/S23") || !strcmp(r, "23/3");
+}
+
+static inline int read_rle (pattern_in_t * in) {
+  char line[256];
+  const char * at;
+  long long w = 0, h = 0, x0 = 0, y0 = 0;
+  int64_t x = 0, y = 0, count = 0;
+  int64_t centre = in->size / 2;
+  int have_pos = 0, c;
+  /* comments, then the header */
+  for (;;) {
+    if (pattern_line(in, line, sizeof(line)) == EOF) {
+      fprintf(stderr, "the RLE pattern has no \"x = \" line\n");
+      return -1;
+    }
+    if (line[0] == 'x')
+      break;
+    if (!strncmp(line, "#CXRLE", 6) && (at = strstr(line, "Pos=")))
+      have_pos = sscanf(at + 4, "%lld,%lld", &x0, &y0) == 2;
+  }
+  if (sscanf(line, "x = %lld , y = %lld", &w, &h) != 2) {
+    fprintf(stderr, "bad RLE header: %s\n", line);
+    return -1;
+  }
+  if ((at = strstr(line, "rule")) && (at = strchr(at, '=')) && !rule_is_life(++at)) {
+    while (isspace((unsigned char)*at))
+      at++;
+    fprintf(stderr, "warning: playing B3/S23, not the rule of the pattern (%s)\n", at);
+  }
+  if (!have_pos) {
+    x0 = -(w / 2);
+    y0 = -(h / 2);
+  }
+  x0 += centre;
+  y0 += centre;
+  while ((c = pattern_getc(in)) != EOF && c != '!') {
+    if (isdigit(c)) {
+      count = count * 10 + (c - '0');
+      continue;
+    }
+    if (isspace(c))
+      continue;
+    if (count == 0)
+      count = 1;
+    if (c == 'b' || c == '.') {
+      x += count;
+    } else if (c == '$') {
+      y += count;
+      x = 0;
+    } else {
+      /* 'o', or any other state of a multi-state pattern */
+      pattern_cells(in, x0 + x, y0 + y, count);
+      x += count;
+    }
+    count = 0;
+  }
+  return 0;
+}
+
+static inline int read_life106 (pattern_in_t * in) {
+  char line[256];
+  long long x, y;
+  int64_t centre = in->size / 2;
+  while (pattern_line(in, line, sizeof(line)) != EOF) {
+    if (line[0] == '#' || line[0] == 0)
+      continue;
+    if (sscanf(line, "%lld %lld", &x, &y) != 2) {
+      fprintf(stderr, "bad Life 1.06 line: %s\n", line);
+      return -1;
+    }
+    pattern_cells(in, centre + x, centre + y, 1);
+  }
+  return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+/* macrocell: node k is the k-th node line, node 0 the empty square. Level 3
+ * nodes are 8x8 leaves written as rows of '.' and '*' ended by '$'; the
+ * others list the nodes of their nw, ne, sw and se quadrants. */
+
+typedef struct {
+  int level;
+  uint32_t child[4];
+  uint64_t bits;        /* leaves: bit 8*r + c is cell (c, r) */
+  uint64_t population;
+} mc_node_t;
+
+static inline void paint_node (pattern_in_t * in, const mc_node_t * nodes, uint32_t k,
+                               int64_t x, int64_t y) {
+  const mc_node_t * n = &nodes[k];
+  int64_t side = (int64_t)1 << n->level, h = side / 2;
+  int r, c, start;
+  if (k == 0)
+    return;
+  if (x >= in->size || y >= in->size || x + side <= 0 || y + side <= 0) {
+    in->dropped += n->population;
+    return;
+  }
+  if (n->level == 3) {
+    for (r = 0; r < 8; r++)
+      for (c = 0; c < 8; c++) {
+        if (!((n->bits >> (8*r + c)) & 1))
+          continue;
+        for (start = c; c < 8 && ((n->bits >> (8*r + c)) & 1); c++)
+          ;
+        pattern_cells(in, x + start, y + r, c - start);
+      }
+    return;
+  }
+  paint_node(in, nodes, n->child[0], x, y);
+  paint_node(in, nodes, n->child[1], x + h, y);
+  paint_node(in, nodes, n->child[2], x, y + h);
+  paint_node(in, nodes, n->child[3], x + h, y + h);
+}
+
+static inline int read_macrocell (pattern_in_t * in) {
+  char line[256];
+  size_t count = 1, capacity = 1024;
+  mc_node_t * nodes = (mc_node_t *) calloc(capacity, sizeof(mc_node_t));
+  int k, r, c;
+  while (pattern_line(in, line, sizeof(line)) != EOF) {
+    mc_node_t n;
+    const char * s;
+    if (line[0] == '[' || line[0] == '#' || line[0] == 0)
+      continue;
+    memset(&n, 0, sizeof(n));
+    if (line[0] == '.' || line[0] == '*' || line[0] == '$') {
+      n.level = 3;
+      for (s = line, r = 0, c = 0; *s && r < 8; s++)
+        if (*s == '$') {
+          r++;
+          c = 0;
+        } else if (c < 8) {
+          if (*s == '*') {
+            n.bits |= (uint64_t)1 << (8*r + c);
+            n.population++;
+          }
+          c++;
+        }
+    } else if (sscanf(line, "%d %u %u %u %u", &n.level, &n.child[0], &n.child[1],
+                      &n.child[2], &n.child[3]) != 5 || n.level < 4 || n.level > 62) {
+      fprintf(stderr, "bad macrocell line (only two-state patterns are read): %s\n", line);
+      free(nodes);
+      return -1;
+    }
+    for (k = 0; n.level > 3 && k < 4; k++) {
+      if (n.child[k] >= count || (n.child[k] && nodes[n.child[k]].level != n.level - 1)) {
+        fprintf(stderr, "bad macrocell node %zu: %s\n", count, line);
+        free(nodes);
+        return -1;
+      }
+      n.population += nodes[n.child[k]].population;
+    }
+    if (count == capacity)
+      nodes = (mc_node_t *) realloc(nodes, (capacity *= 2) * sizeof(mc_node_t));
+    nodes[count++] = n;
+  }
+  /* the last node is the root, centred on the origin */
+  if (count > 1) {
+    int64_t half = (int64_t)1 << (nodes[count-1].level - 1);
+    paint_node(in, nodes, count - 1, in->size / 2 - half, in->size / 2 - half);
+  }
+  free(nodes);
+  return 0;
+}
+
+/* decodes a pattern of the given format; returns 0, or -1 after printing why */
+static inline int read_pattern (pattern_in_t * in, int format) {
+  int result;
+  in->dropped = 0;
+  switch (format) {
+    case FORMAT_RLE: result = read_rle(in); break;
+    case FORMAT_LIFE106: result = read_life106(in); break;
+    case FORMAT_MACROCELL: result = read_macrocell(in); break;
+    default: return -1;
+  }
+  if (!result && in->dropped)
+    fprintf(stderr, "warning: %llu live cells of the pattern are outside the board\n",
+            (unsigned long long)in->dropped);
+  return result;
+}
+
+/* ------------------------------------------------------------------------- */
+/* the writers read the board packed one bit per cell: cell (x, y) is bit x%64
+ * of word y*stride + x/64, and the bits past size are clear */
+
+static inline int packed_cell (const uint64_t * row, int x) {
+  return (row[x/64] >> (x%64)) & 1;
+}
+
+/* the first x in [from, n) whose cell is in the given state, or n */
+static inline int packed_find (const uint64_t * row, int n, int from, int state) {
+  int w = from / 64;
+  uint64_t bits;
+  if (from >= n)
+    return n;
+  bits = (state ? row[w] : ~row[w]) & (~(uint64_t)0 << (from % 64));
+  while (!bits) {
+    if (++w * 64 >= n)
+      return n;
+    bits = state ? row[w] : ~row[w];
+  }
+  from = w*64 + __builtin_ctzll(bits);
+  return from < n ? from : n;
+}
+
+/* the last live cell of a row, or -1 */
+static inline int packed_last (const uint64_t * row, int n) {
+  int w;
+  for (w = (n + 63) / 64 - 1; w >= 0; w--)
+    if (row[w])
+      return w*64 + 63 - __builtin_clzll(row[w]);
+  return -1;
+}
+
+/* cells x to x+7 of a row, any of them may be off the board */
+static inline unsigned packed_byte (const uint64_t * row, int n, int64_t x) {
+  unsigned b = 0;
+  int c;
+  if (x >= 0 && x + 8 <= n) {
+    int w = x / 64, shift = x % 64;
+    uint64_t v = row[w] >> shift;
+    if (shift > 56)
+      v |= row[w+1] << (64 - shift);
+    return v & 0xff;
+  }
+  for (c = 0; c < 8; c++)
+    if (x + c >= 0 && x + c < n && packed_cell(row, x + c))
+      b |= 1u << c;
+  return b;
+}
+
+static inline void write_text (FILE * out, int size, const uint64_t * cells, size_t stride) {
+  int x, y;
+  for (y = 0; y < size; y++) {
+    const uint64_t * row = cells + y*stride;
+    for (x = 0; x < size; x++)
+      putc_unlocked(packed_cell(row, x) ? 'x' : ' ', out);
+    putc_unlocked('\n', out);
+  }
+}
+
+/* RLE lines are kept under 70 characters */
+static inline void rle_token (FILE * out, int * column, int64_t count, char c) {
+  char token[24];
+  int n = sizeof(token);
+  token[--n] = c;
+  if (count > 1)
+    for (; count; count /= 10)
+      token[--n] = '0' + count % 10;
+  if (*column + (int)sizeof(token) - n > 70) {
+    putc_unlocked('\n', out);
+    *column = 0;
+  }
+  *column += sizeof(token) - n;
+  for (; n < (int)sizeof(token); n++)
+    putc_unlocked(token[n], out);
+}
+
+static inline void write_rle (FILE * out, int size, const uint64_t * cells, size_t stride) {
+  int x, y, minx = size, maxx = -1, miny = size, maxy = -1, column = 0, end;
+  int64_t rows = 0;
+  for (y = 0; y < size; y++) {
+    const uint64_t * row = cells + y*stride;
+    int first = packed_find(row, size, 0, 1);
+    if (first == size)
+      continue;
+    minx = first < minx ? first : minx;
+    x = packed_last(row, size);
+    maxx = x > maxx ? x : maxx;
+    miny = y < miny ? y : miny;
+    maxy = y;
+  }
+  if (maxy < 0) {
+    fprintf(out, "x = 0, y = 0, rule = B3/S23\n!\n");
+    return;
+  }
+  fprintf(out, "#CXRLE Pos=%d,%d\n", minx - size/2, miny - size/2);
+  fprintf(out, "x = %d, y = %d, rule = B3/S23\n", maxx - minx + 1, maxy - miny + 1);
+  for (y = miny; y <= maxy; y++, rows++) {
+    const uint64_t * row = cells + y*stride;
+    for (x = minx; x <= maxx; x = end) {
+      int state = packed_cell(row, x);
+      end = packed_find(row, maxx + 1, x, !state);
+      /* the dead cells at the end of a row are implied */
+      if (!state && end > maxx)
+        break;
+      if (rows) {
+        rle_token(out, &column, rows, '$');
+        rows = 0;
+      }
+      rle_token(out, &column, end - x, state ? 'o' : 'b');
+    }
+  }
+  rle_token(out, &column, 1, '!');
+  putc_unlocked('\n', out);
+}
+
+static inline void write_life106 (FILE * out, int size, const uint64_t * cells, size_t stride) {
+  int x, y;
+  fprintf(out, "#Life 1.06\n");
+  for (y = 0; y < size; y++) {
+    const uint64_t * row = cells + y*stride;
+    for (x = packed_find(row, size, 0, 1); x < size; x = packed_find(row, size, x + 1, 1))
+      fprintf(out, "%d %d\n", x - size/2, y - size/2);
+  }
+}
+
+/* the macrocell writer numbers every distinct node once, in a hash table
+ * from the node to its number, and writes it the first time it is seen */
+
+typedef struct {
+  FILE * out;
+  int size;
+  const uint64_t * cells;
+  size_t stride;
+  mc_node_t * keys;     /* open addressing; population holds the number */
+  size_t capacity, count;
+} mc_writer_t;
+
+static inline size_t mc_hash (const mc_node_t * n) {
+  uint64_t h = n->bits * 0x9e3779b97f4a7c15ULL ^ (uint64_t)n->level;
+  int k;
+  for (k = 0; k < 4; k++)
+    h = (h ^ n->child[k]) * 0xbf58476d1ce4e5b9ULL;
+  return h ^ (h >> 29);
+}
+
+static inline int mc_same (const mc_node_t * a, const mc_node_t * b) {
+  return a->level == b->level && a->bits == b->bits &&
+         !memcmp(a->child, b->child, sizeof(a->child));
+}
+
+/* the number of node n, which is written if it is new */
+static inline uint32_t mc_number (mc_writer_t * w, mc_node_t * n) {
+  size_t k, r, c;
+  if (2 * (w->count + 1) > w->capacity) {
+    mc_node_t * old = w->keys;
+    size_t old_capacity = w->capacity;
+    w->capacity = old_capacity ? 2 * old_capacity : 1024;
+    w->keys = (mc_node_t *) calloc(w->capacity, sizeof(mc_node_t));
+    for (k = 0; k < old_capacity; k++)
+      if (old[k].level) {
+        size_t b = mc_hash(&old[k]) & (w->capacity - 1);
+        while (w->keys[b].level)
+          b = (b + 1) & (w->capacity - 1);
+        w->keys[b] = old[k];
+      }
+    free(old);
+  }
+  for (k = mc_hash(n) & (w->capacity - 1); w->keys[k].level; k = (k + 1) & (w->capacity - 1))
+    if (mc_same(&w->keys[k], n))
+      return (uint32_t)w->keys[k].population;
+  n->population = ++w->count;
+  w->keys[k] = *n;
+  if (n->level == 3) {
+    int last = 7;
+    while (!((n->bits >> (8*last)) & 0xff))
+      last--;
+    for (r = 0; r <= (size_t)last; r++) {
+      int end = 7;
+      while (end >= 0 && !((n->bits >> (8*r + end)) & 1))
+        end--;
+      for (c = 0; (int)c <= end; c++)
+        putc_unlocked((n->bits >> (8*r + c)) & 1 ? '*' : '.', w->out);
+      putc_unlocked('$', w->out);
+    }
+    putc_unlocked('\n', w->out);
+  } else {
+    fprintf(w->out, "%d %u %u %u %u\n", n->level, n->child[0], n->child[1],
+            n->child[2], n->child[3]);
+  }
+  return (uint32_t)n->population;
+}
+
+static inline uint32_t mc_build (mc_writer_t * w, int level, int64_t x, int64_t y) {
+  int64_t side = (int64_t)1 << level, h = side / 2;
+  mc_node_t n;
+  int r;
+  if (x >= w->size || y >= w->size || x + side <= 0 || y + side <= 0)
+    return 0;
+  memset(&n, 0, sizeof(n));
+  n.level = level;
+  if (level == 3) {
+    for (r = 0; r < 8; r++)
+      if (y + r >= 0 && y + r < w->size)
+        n.bits |= (uint64_t)packed_byte(w->cells + (y + r)*w->stride, w->size, x) << 8*r;
+    return n.bits ? mc_number(w, &n) : 0;
+  }
+  n.child[0] = mc_build(w, level - 1, x, y);
+  n.child[1] = mc_build(w, level - 1, x + h, y);
+  n.child[2] = mc_build(w, level - 1, x, y + h);
+  n.child[3] = mc_build(w, level - 1, x + h, y + h);
+  if (!(n.child[0] | n.child[1] | n.child[2] | n.child[3]))
+    return 0;
+  return mc_number(w, &n);
+}
+
+static inline void write_macrocell (FILE * out, int size, const uint64_t * cells, size_t stride) {
+  mc_writer_t w = {out, size, cells, stride, NULL, 0, 0};
+  int level = 3;
+  /* the root is centred on the origin and covers the board */
+  while (((int64_t)1 << (level - 1)) < size - size/2)
+    level++;
+  fprintf(out, "[M2] (gol)\n#R B3/S23\n");
+  if (!mc_build(&w, level, size/2 - ((int64_t)1 << (level - 1)),
+                size/2 - ((int64_t)1 << (level - 1))))
+    /* an empty board still needs a root */
+    fprintf(out, "$\n");
+  free(w.keys);
+}
+
+/* writes "size steps" and the board in the given format */
+static inline void write_pattern (FILE * out, int format, int size, long long steps,
+                                  const uint64_t * cells, size_t stride) {
+  fprintf(out, "%d %lld\n", size, steps);
+  switch (format) {
+    case FORMAT_RLE: write_rle(out, size, cells, stride); break;
+    case FORMAT_LIFE106: write_life106(out, size, cells, stride); break;
+    case FORMAT_MACROCELL: write_macrocell(out, size, cells, stride); break;
+    default: write_text(out, size, cells, stride); break;
+  }
+}
+
+#endif
@@ -0,0 +1,137 @@
+/*
+* A persistent pthread pool synchronised by a sense-reversing barrier.
+*
+* The threads are created once and live until pool_destroy. pool_run hands the
+* same job to every thread (the caller runs it as thread 0) and returns when
+* all of them are done. Inside a job the threads meet at pool_barrier, which
+* spins for a while and then sleeps on a futex; the last thread to arrive runs
+* the serial callback before anyone is released, so it can swap boards.
+*
+*/
+#ifndef POOL_H
+#define POOL_H
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <sys/sysinfo.h>
+
+#define BARRIER_SPINS 4096
+
+typedef struct {
+  atomic_int count;     /* threads that still have to arrive */
+  atomic_int sense;     /* flips every time the barrier opens */
+  atomic_int sleepers;  /* threads waiting on the futex */
+  int nthreads;
+  int spins;
+} barrier_t;
+
+static void barrier_init (barrier_t * barrier, int nthreads) {
+  atomic_init(&barrier->count, nthreads);
+  atomic_init(&barrier->sense, 0);
+  atomic_init(&barrier->sleepers, 0);
+  barrier->nthreads = nthreads;
+  /* spinning only pays off when every thread has a core of its own */
+  barrier->spins = nthreads <= get_nprocs() ? BARRIER_SPINS : 0;
+}
+
+/* sense is private to the calling thread and starts at 0 */
+static void barrier_wait (barrier_t * barrier, int * sense, void (*serial)(void *), void * arg) {
+  int s = !*sense;
+  int i;
+  *sense = s;
+  if (atomic_fetch_sub_explicit(&barrier->count, 1, memory_order_acq_rel) == 1) {
+    if (serial)
+      serial(arg);
+    atomic_store_explicit(&barrier->count, barrier->nthreads, memory_order_relaxed);
+    atomic_store(&barrier->sense, s);
+    if (atomic_load(&barrier->sleepers))
+      syscall(SYS_futex, &barrier->sense, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+    return;
+  }
+  for (i=0; i<barrier->spins; i++) {
+    if (atomic_load_explicit(&barrier->sense, memory_order_acquire) == s)
+      return;
+    __builtin_ia32_pause();
+  }
+  atomic_fetch_add(&barrier->sleepers, 1);
+  while (atomic_load(&barrier->sense) != s)
+    syscall(SYS_futex, &barrier->sense, FUTEX_WAIT_PRIVATE, !s, NULL, NULL, 0);
+  atomic_fetch_sub(&barrier->sleepers, 1);
+}
+
+typedef struct pool pool_t;
+typedef void (*pool_job_t)(pool_t * pool, int thread_number, void * arg);
+
+typedef struct {
+  pool_t * pool;
+  int thread_number;
+} pool_thread_t;
+
+struct pool {
+  int nthreads;
+  pthread_t * threads;
+  pool_thread_t * args;
+  int * senses;         /* the barrier sense of every thread */
+  barrier_t barrier;
+  pool_job_t job;       /* NULL tells the threads to exit */
+  void * arg;
+};
+
+static inline void pool_barrier (pool_t * pool, int thread_number, void (*serial)(void *), void * arg) {
+  barrier_wait(&pool->barrier, &pool->senses[thread_number], serial, arg);
+}
+
+static void * pool_main (void * p) {
+  pool_thread_t * self = (pool_thread_t *) p;
+  pool_t * pool = self->pool;
+  for (;;) {
+    pool_barrier(pool, self->thread_number, NULL, NULL);
+    if (!pool->job)
+      return NULL;
+    pool->job(pool, self->thread_number, pool->arg);
+    pool_barrier(pool, self->thread_number, NULL, NULL);
+  }
+}
+
+static void pool_init (pool_t * pool, int nthreads) {
+  int i;
+  pool->nthreads = nthreads;
+  pool->threads = (pthread_t *) malloc(nthreads*sizeof(pthread_t));
+  pool->args = (pool_thread_t *) malloc(nthreads*sizeof(pool_thread_t));
+  pool->senses = (int *) calloc(nthreads, sizeof(int));
+  pool->job = NULL;
+  pool->arg = NULL;
+  barrier_init(&pool->barrier, nthreads);
+  /* the thread calling pool_run is thread 0 */
+  for (i=1; i<nthreads; i++) {
+    pool->args[i].pool = pool;
+    pool->args[i].thread_number = i;
+    pthread_create(&pool->threads[i], NULL, pool_main, &pool->args[i]);
+  }
+}
+
+static void pool_run (pool_t * pool, pool_job_t job, void * arg) {
+  pool->job = job;
+  pool->arg = arg;
+  pool_barrier(pool, 0, NULL, NULL);
+  job(pool, 0, arg);
+  pool_barrier(pool, 0, NULL, NULL);
+}
+
+static void pool_destroy (pool_t * pool) {
+  int i;
+  pool->job = NULL;
+  pool_barrier(pool, 0, NULL, NULL);
+  for (i=1; i<pool->nthreads; i++)
+    pthread_join(pool->threads[i], NULL);
+  free(pool->threads);
+  free(pool->args);
+  free(pool->senses);
+}
+
+#endif
@@ -0,0 +1,197 @@
+/*
+* Periodic snapshots written by a background thread.
+*
+* GOL_SNAPSHOT_EVERY=N turns them on. The engine packs the board into one
+* of two buffers, one bit per cell, at the first generation it reaches at
+* or after every multiple of N (engines that play several generations per
+* step can overshoot). It then goes on playing while a writer thread
+* encodes the buffer and writes it. The engine only waits when both
+* buffers are still being written.
+*
+* Snapshot g goes to <GOL_SNAPSHOT>.<g>.<format> (default prefix
+* "snapshot"). GOL_SNAPSHOT_FORMAT picks rle (the default), mc, life106 or
+* text; see patterns.h. Every snapshot is a complete input whose header
+* counts the generations that were still to play, so a run can be resumed
+* from it. A file is written under a temporary name and renamed when it is
+* complete.
+*
+* GOL_TRACE=path also sends every generation the engine hands over to a
+* trace, a keyframe every GOL_TRACE_KEYFRAME generations (default 100) and
+* deltas in between; see trace.h. The engines hand over generation 0 and
+* every generation they reach; gol-hashlife stops its steps at every
+* generation that is due. The MPI engine (trabalho2) has its own
+* checkpoints and ignores both variables.
+*
+* A trace costs a pass over the board per generation to pack it, which
+* trabalho/gol shares out among its threads, and the writer's XOR and
+* compression of one bit per cell, on its own thread: about 3 ms and 8 ms
+* a generation for 3000x3000 cells. With a core to spare the run only
+* pays for the packing, until a generation takes less than the writer
+* does; the run then goes at the writer's pace.
+*
+*/
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "patterns.h"
+#include "trace.h"
+#include "output.h"
+
+#define SNAPSHOT_BUFFERS 2
+
+typedef struct {
+  uint64_t * words;       /* size rows of words words */
+  long long generation;
+  int full;               /* waiting for the writer */
+} snapshot_buffer_t;
+
+typedef struct {
+  int size, words;
+  long long steps, every, next;
+  long long file_next;    /* the next pattern file, for the writer */
+  trace_writer_t * trace;
+  const char * prefix;
+  int format;
+  snapshot_buffer_t buffers[SNAPSHOT_BUFFERS];
+  int head, tail;         /* the next buffer to fill and to write */
+  int done;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  pthread_t writer;
+} snapshots_t;
+
+static void write_snapshot (snapshots_t * s, snapshot_buffer_t * b) {
+  char path[4096], partial[4200];
+  FILE * f;
+  snprintf(path, sizeof(path), "%s.%lld.%s", s->prefix, b->generation, format_names[s->format]);
+  snprintf(partial, sizeof(partial), "%s.partial", path);
+  if (!(f = fopen(partial, "w"))) {
+    perror(partial);
+    return;
+  }
+  write_pattern(f, s->format, s->size, s->steps - b->generation, b->words, s->words);
+  if (fclose(f) || rename(partial, path))
+    perror(path);
+}
+
+static void * snapshot_writer (void * arg) {
+  snapshots_t * s = (snapshots_t *) arg;
+  for (;;) {
+    snapshot_buffer_t * b = &s->buffers[s->tail];
+    int full;
+    pthread_mutex_lock(&s->lock);
+    while (!b->full && !s->done)
+      pthread_cond_wait(&s->cond, &s->lock);
+    full = b->full;
+    pthread_mutex_unlock(&s->lock);
+    if (!full)
+      return NULL;
+    if (s->trace)
+      trace_frame(s->trace, b->words, b->generation);
+    if (s->every && b->generation >= s->file_next) {
+      write_snapshot(s, b);
+      s->file_next = (b->generation / s->every + 1) * s->every;
+    }
+    pthread_mutex_lock(&s->lock);
+    b->full = 0;
+    s->tail = (s->tail + 1) % SNAPSHOT_BUFFERS;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+  }
+}
+
+/* starts the writer; NULL when neither GOL_SNAPSHOT_EVERY nor GOL_TRACE is
+ * set */
+static snapshots_t * snapshots_start (int size, long long steps) {
+  const char * every = getenv("GOL_SNAPSHOT_EVERY");
+  const char * format = getenv("GOL_SNAPSHOT_FORMAT");
+  const char * trace = getenv("GOL_TRACE");
+  const char * keyframe = getenv("GOL_TRACE_KEYFRAME");
+  snapshots_t * s;
+  int k;
+  if ((!every || atoll(every) <= 0) && !trace)
+    return NULL;
+  s = (snapshots_t *) calloc(1, sizeof(snapshots_t));
+  s->size = size;
+  s->words = (size + 63) / 64;
+  s->steps = steps;
+  s->every = every && atoll(every) > 0 ? atoll(every) : 0;
+  s->file_next = s->every;
+  if (trace)
+    s->trace = trace_create(trace, size, s->words, steps,
+                            keyframe && atoll(keyframe) > 0 ? atoll(keyframe) : 100);
+  /* a trace takes every generation */
+  s->next = s->trace ? 0 : s->every;
+  if (!s->trace && !s->every) {
+    free(s);
+    return NULL;
+  }
+  s->prefix = getenv("GOL_SNAPSHOT") ? getenv("GOL_SNAPSHOT") : "snapshot";
+  s->format = FORMAT_RLE;
+  for (k = 0; format && k <= FORMAT_MACROCELL; k++)
+    if (!strcmp(format, format_names[k]))
+      s->format = k;
+  for (k = 0; k < SNAPSHOT_BUFFERS; k++)
+    s->buffers[k].words = (uint64_t *) calloc((size_t)size * s->words, sizeof(uint64_t));
+  pthread_mutex_init(&s->lock, NULL);
+  pthread_cond_init(&s->cond, NULL);
+  pthread_create(&s->writer, NULL, snapshot_writer, s);
+  return s;
+}
+
+/* the buffer for a snapshot of this generation, or NULL when none is due;
+ * the caller fills its rows and hands it over with snapshot_give */
+static uint64_t * snapshot_take (snapshots_t * s, long long generation) {
+  snapshot_buffer_t * b;
+  if (!s || generation < s->next)
+    return NULL;
+  s->next = s->trace ? generation + 1 : (generation / s->every + 1) * s->every;
+  b = &s->buffers[s->head];
+  pthread_mutex_lock(&s->lock);
+  while (b->full)
+    pthread_cond_wait(&s->cond, &s->lock);
+  pthread_mutex_unlock(&s->lock);
+  b->generation = generation;
+  return b->words;
+}
+
+static void snapshot_give (snapshots_t * s) {
+  pthread_mutex_lock(&s->lock);
+  s->buffers[s->head].full = 1;
+  s->head = (s->head + 1) % SNAPSHOT_BUFFERS;
+  pthread_cond_broadcast(&s->cond);
+  pthread_mutex_unlock(&s->lock);
+}
+
+/* row j of a snapshot from one byte per cell; a cell is alive when it has a
+ * bit of mask set */
+static inline void snapshot_cells (snapshots_t * s, uint64_t * words, int j,
+                                   const unsigned char * cells, unsigned char mask) {
+  pack_cells(cells, s->size, mask, (char *)(words + (size_t)j*s->words));
+}
+
+/* waits for the writer to write what is left and stops it */
+static void snapshots_finish (snapshots_t * s) {
+  int k;
+  if (!s)
+    return;
+  pthread_mutex_lock(&s->lock);
+  s->done = 1;
+  pthread_cond_broadcast(&s->cond);
+  pthread_mutex_unlock(&s->lock);
+  pthread_join(s->writer, NULL);
+  if (s->trace)
+    trace_close(s->trace);
+  for (k = 0; k < SNAPSHOT_BUFFERS; k++)
+    free(s->buffers[k].words);
+  pthread_mutex_destroy(&s->lock);
+  pthread_cond_destroy(&s->cond);
+  free(s);
+}
+
+#endif
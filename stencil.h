@@ -0,0 +1,160 @@
+/*
+* Row kernels for the byte-per-cell boards.
+*
+* play_row computes one row of the next generation from the row above, the row
+* itself and the row below. Every pointer points at the first cell of the row
+* and the cells at index -1 and n must be readable (the halo). Cells are 0 or 1
+* and out must not overlap the input rows.
+*
+* The scalar kernel is the reference; the SSE2, AVX2 and AVX-512 ones compute
+* 16, 32 and 64 cells per instruction and are picked at startup from CPUID.
+* Setting GOL_KERNEL=scalar|sse2|avx2|avx512 forces a kernel.
+*
+*/
+#ifndef STENCIL_H
+#define STENCIL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <immintrin.h>
+
+typedef void (*play_row_t)(const unsigned char * up, const unsigned char * mid,
+                           const unsigned char * down, unsigned char * out, int n);
+
+static void play_row_scalar (const unsigned char * up, const unsigned char * mid,
+                             const unsigned char * down, unsigned char * out, int n) {
+  int j, a;
+  for (j=0; j<n; j++) {
+    a = up[j-1] + up[j] + up[j+1] + mid[j-1] + mid[j+1] + down[j-1] + down[j] + down[j+1];
+    if (a == 2) {
+      out[j] = mid[j];
+    } else if (a == 3) {
+      out[j] = 1;
+    } else {
+      out[j] = 0;
+    }
+  }
+}
+
+/* the neighbour count or'ed with the cell is 3 exactly when the cell is alive
+ * in the next generation, so a single compare replaces both branches */
+
+__attribute__((target("sse2")))
+static void play_row_sse2 (const unsigned char * up, const unsigned char * mid,
+                           const unsigned char * down, unsigned char * out, int n) {
+  const __m128i three = _mm_set1_epi8(3);
+  const __m128i one = _mm_set1_epi8(1);
+  int j = 0;
+  if (n < 16) {
+    play_row_scalar(up, mid, down, out, n);
+    return;
+  }
+  /* the last vector may overlap the one before it */
+  for (;; j+=16) {
+    if (j+16 > n)
+      j = n-16;
+    __m128i c = _mm_loadu_si128((const __m128i *)(mid+j));
+    __m128i a = _mm_add_epi8(
+        _mm_add_epi8(_mm_add_epi8(_mm_loadu_si128((const __m128i *)(up+j-1)),
+                                  _mm_loadu_si128((const __m128i *)(up+j))),
+                     _mm_add_epi8(_mm_loadu_si128((const __m128i *)(up+j+1)),
+                                  _mm_loadu_si128((const __m128i *)(mid+j-1)))),
+        _mm_add_epi8(_mm_add_epi8(_mm_loadu_si128((const __m128i *)(mid+j+1)),
+                                  _mm_loadu_si128((const __m128i *)(down+j-1))),
+                     _mm_add_epi8(_mm_loadu_si128((const __m128i *)(down+j)),
+                                  _mm_loadu_si128((const __m128i *)(down+j+1)))));
+    __m128i alive = _mm_cmpeq_epi8(_mm_or_si128(a, c), three);
+    _mm_storeu_si128((__m128i *)(out+j), _mm_and_si128(alive, one));
+    if (j+16 == n)
+      break;
+  }
+}
+
+__attribute__((target("avx2")))
+static void play_row_avx2 (const unsigned char * up, const unsigned char * mid,
+                           const unsigned char * down, unsigned char * out, int n) {
+  const __m256i three = _mm256_set1_epi8(3);
+  const __m256i one = _mm256_set1_epi8(1);
+  int j = 0;
+  if (n < 32) {
+    play_row_sse2(up, mid, down, out, n);
+    return;
+  }
+  for (;; j+=32) {
+    if (j+32 > n)
+      j = n-32;
+    __m256i c = _mm256_loadu_si256((const __m256i *)(mid+j));
+    __m256i a = _mm256_add_epi8(
+        _mm256_add_epi8(_mm256_add_epi8(_mm256_loadu_si256((const __m256i *)(up+j-1)),
+                                        _mm256_loadu_si256((const __m256i *)(up+j))),
+                        _mm256_add_epi8(_mm256_loadu_si256((const __m256i *)(up+j+1)),
+                                        _mm256_loadu_si256((const __m256i *)(mid+j-1)))),
+        _mm256_add_epi8(_mm256_add_epi8(_mm256_loadu_si256((const __m256i *)(mid+j+1)),
+                                        _mm256_loadu_si256((const __m256i *)(down+j-1))),
+                        _mm256_add_epi8(_mm256_loadu_si256((const __m256i *)(down+j)),
+                                        _mm256_loadu_si256((const __m256i *)(down+j+1)))));
+    __m256i alive = _mm256_cmpeq_epi8(_mm256_or_si256(a, c), three);
+    _mm256_storeu_si256((__m256i *)(out+j), _mm256_and_si256(alive, one));
+    if (j+32 == n)
+      break;
+  }
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void play_row_avx512 (const unsigned char * up, const unsigned char * mid,
+                             const unsigned char * down, unsigned char * out, int n) {
+  const __m512i three = _mm512_set1_epi8(3);
+  const __m512i one = _mm512_set1_epi8(1);
+  int j = 0;
+  if (n < 64) {
+    play_row_avx2(up, mid, down, out, n);
+    return;
+  }
+  for (;; j+=64) {
+    if (j+64 > n)
+      j = n-64;
+    __m512i c = _mm512_loadu_si512(mid+j);
+    __m512i a = _mm512_add_epi8(
+        _mm512_add_epi8(_mm512_add_epi8(_mm512_loadu_si512(up+j-1), _mm512_loadu_si512(up+j)),
+                        _mm512_add_epi8(_mm512_loadu_si512(up+j+1), _mm512_loadu_si512(mid+j-1))),
+        _mm512_add_epi8(_mm512_add_epi8(_mm512_loadu_si512(mid+j+1), _mm512_loadu_si512(down+j-1)),
+                        _mm512_add_epi8(_mm512_loadu_si512(down+j), _mm512_loadu_si512(down+j+1))));
+    __mmask64 alive = _mm512_cmpeq_epi8_mask(_mm512_or_si512(a, c), three);
+    _mm512_storeu_si512(out+j, _mm512_maskz_mov_epi8(alive, one));
+    if (j+64 == n)
+      break;
+  }
+}
+
+/* pick the widest kernel this cpu runs, unless GOL_KERNEL says otherwise; a
+ * kernel the cpu lacks or an unknown name is reported with the one used */
+static play_row_t select_play_row (void) {
+  static const char * names[] = {"scalar", "sse2", "avx2", "avx512"};
+  const play_row_t kernels[] = {play_row_scalar, play_row_sse2, play_row_avx2, play_row_avx512};
+  const char * forced = getenv("GOL_KERNEL");
+  int best, k = 3;
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+    best = 3;
+  else if (__builtin_cpu_supports("avx2"))
+    best = 2;
+  else if (__builtin_cpu_supports("sse2"))
+    best = 1;
+  else
+    best = 0;
+  if (forced && *forced) {
+    for (k = 0; k < 4 && strcmp(forced, names[k]); k++)
+      ;
+    if (k == 4) {
+      fprintf(stderr, "unknown GOL_KERNEL %s (scalar, sse2, avx2 or avx512), using %s\n",
+              forced, names[best]);
+      k = best;
+    } else if (k > best) {
+      fprintf(stderr, "this cpu can not run the %s kernel, using %s\n", forced, names[best]);
+    }
+  }
+  return kernels[k < best ? k : best];
+}
+
+#endif
@@ -0,0 +1,108 @@
+/*
+* Temporal blocking: a tile of the board is advanced several generations at a
+* time while it sits in a small scratch buffer, instead of streaming the whole
+* board through memory once per generation.
+*
+* To advance a tile by depth generations its cells are copied together with a
+* halo depth cells wide. Each generation the valid region shrinks by one cell
+* on every side (a trapezoid in time), so after depth generations exactly the
+* tile itself is valid and is copied to the new board. Cells outside the board
+* are never computed and stay dead, as the halo of the board does.
+*
+*/
+#ifndef TEMPORAL_H
+#define TEMPORAL_H
+
+#include <string.h>
+#include "board.h"
+#include "stencil.h"
+
+typedef struct {
+  cell_t * a;
+  cell_t * b;
+  ptrdiff_t stride;
+  size_t bytes;
+} block_scratch_t;
+
+/* scratch space for tiles of up to tile x tile cells advanced depth generations */
+static void block_scratch_init (block_scratch_t * scratch, int tile, int depth) {
+  int side = tile + 2*depth + 2;
+  scratch->stride = (side + BOARD_ALIGN - 1) / BOARD_ALIGN * BOARD_ALIGN;
+  scratch->bytes = (size_t)scratch->stride * side;
+  scratch->a = (cell_t *) malloc(scratch->bytes);
+  scratch->b = (cell_t *) malloc(scratch->bytes);
+}
+
+static void block_scratch_free (block_scratch_t * scratch) {
+  free(scratch->a);
+  free(scratch->b);
+}
+
+static inline int max_int (int a, int b) { return a > b ? a : b; }
+static inline int min_int (int a, int b) { return a < b ? a : b; }
+
+/* clears the part of a window of rows x cols cells, and of the ring around
+ * it, that lies off the board: only rows [r0, r1) x columns [c0, c1) are on
+ * it. play_block reads those cells but never writes them. */
+static void clear_off_board (cell_t * window, ptrdiff_t stride, int rows, int cols,
+                             int r0, int r1, int c0, int c1) {
+  int r;
+  if (r0 == 0 && r1 == rows && c0 == 0 && c1 == cols)
+    return;
+  for (r = -1; r <= rows; ++r) {
+    cell_t * row = window + r*stride;
+    if (r < r0 || r >= r1) {
+      memset(row - 1, 0, cols + 2);
+    } else {
+      memset(row - 1, 0, c0 + 1);
+      memset(row + c1, 0, cols + 1 - c1);
+    }
+  }
+}
+
+/* writes rows [i0, i1) x columns [j0, j1) of board, depth generations later,
+ * into newboard; returns nonzero if any of those cells changed */
+static int play_block (const board_t * board, board_t * newboard, int i0, int i1, int j0, int j1,
+                       int depth, block_scratch_t * scratch, play_row_t play_row) {
+  const int size = board->size;
+  const ptrdiff_t stride = scratch->stride;
+  /* the tile and its halo, clipped to the board, in board coordinates */
+  const int top = max_int(i0 - depth, 0), bottom = min_int(i1 + depth, size);
+  const int left = max_int(j0 - depth, 0), right = min_int(j1 + depth, size);
+  /* local cell (r, c) is board cell (i0 - depth + r, j0 - depth + c) */
+  cell_t * src = scratch->a + stride + 1;
+  cell_t * dst = scratch->b + stride + 1;
+  cell_t * tmp;
+  int i, g, diff = 0;
+  const int rows = i1 - i0 + 2*depth, cols = j1 - j0 + 2*depth;
+
+  clear_off_board(src, stride, rows, cols, top - i0 + depth, bottom - i0 + depth,
+                  left - j0 + depth, right - j0 + depth);
+  clear_off_board(dst, stride, rows, cols, top - i0 + depth, bottom - i0 + depth,
+                  left - j0 + depth, right - j0 + depth);
+  for (i = top; i < bottom; ++i)
+    memcpy(src + (i - i0 + depth)*stride + (left - j0 + depth), board_row(board, i) + left, right - left);
+
+  for (g = 1; g <= depth; ++g) {
+    int r0 = max_int(i0 - depth + g, top), r1 = min_int(i1 + depth - g, bottom);
+    int c0 = max_int(j0 - depth + g, left), c1 = min_int(j1 + depth - g, right);
+    for (i = r0; i < r1; ++i) {
+      cell_t * mid = src + (i - i0 + depth)*stride + (c0 - j0 + depth);
+      play_row(mid - stride, mid, mid + stride, dst + (mid - src), c1 - c0);
+    }
+    tmp = src;
+    src = dst;
+    dst = tmp;
+  }
+
+  for (i = i0; i < i1; ++i) {
+    cell_t * in = board_row(board, i) + j0;
+    cell_t * out = board_row(newboard, i) + j0;
+    memcpy(out, src + (i - i0 + depth)*stride + depth, j1 - j0);
+    if (!diff)
+      diff = memcmp(out, in, j1 - j0);
+  }
+  return diff;
+}
+
+#endif
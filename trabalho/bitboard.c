@@ -0,0 +1,169 @@
+/*
+* The Game of Life
+*
+* a cell is born, if it has exactly three neighbours
+* a cell dies of loneliness, if it has less than two neighbours
+* a cell dies of overcrowding, if it has more than three neighbours
+* a cell survives to the next generation, if it does not die of loneliness
+* or overcrowding
+*
+* In this version every row is packed into 64-bit words, one bit per cell, and
+* the next generation is computed 64 cells at a time with bitwise adders.
+* It reads the same input as sequencial.c and prints the same final board.
+*
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "../loader.h"
+#include "../output.h"
+#include "../snapshot.h"
+
+typedef uint64_t word_t;
+
+#define WORD_BITS 64
+
+/* a packed board: rows 0 and size+1 and the first and last word of every row
+ * are a halo that always stays zero */
+typedef struct {
+  int size;
+  int words;   /* words per row, halo included */
+  word_t * cells;
+} bitboard_t;
+
+bitboard_t * allocate_board (int size) {
+  bitboard_t * board = (bitboard_t *) malloc(sizeof(bitboard_t));
+  board->size = size;
+  board->words = (size + WORD_BITS - 1) / WORD_BITS + 2;
+  board->cells = (word_t *) calloc((size_t)board->words * (size+2), sizeof(word_t));
+  return board;
+}
+
+void free_board (bitboard_t * board) {
+  free(board->cells);
+  free(board);
+}
+
+static inline word_t * row (bitboard_t * board, int j) {
+  return board->cells + (size_t)j * board->words;
+}
+
+static inline int get_cell (bitboard_t * board, int i, int j) {
+  return (row(board, j+1)[i/WORD_BITS + 1] >> (i%WORD_BITS)) & 1;
+}
+
+static inline void set_cell (bitboard_t * board, int i, int j) {
+  row(board, j+1)[i/WORD_BITS + 1] |= (word_t)1 << (i%WORD_BITS);
+}
+
+/* full adder: s gets the low bit and c the carry of a+b+d, bit by bit */
+#define ADD3(a, b, d, s, c) do { \
+  word_t t_ = (a) ^ (b);         \
+  s = t_ ^ (d);                  \
+  c = ((a) & (b)) | (t_ & (d));  \
+} while (0)
+
+/* the neighbours to the west and east of every cell of word w */
+#define WEST(r, w) (((r)[w] << 1) | ((r)[(w)-1] >> (WORD_BITS-1)))
+#define EAST(r, w) (((r)[w] >> 1) | ((r)[(w)+1] << (WORD_BITS-1)))
+
+void play (bitboard_t * board, bitboard_t * newboard) {
+  int j, w;
+  int size = board->size;
+  int last = board->words - 2;
+  /* cells past the right edge of the board must stay dead */
+  word_t tail = size % WORD_BITS ? ((word_t)1 << (size % WORD_BITS)) - 1 : ~(word_t)0;
+
+  for (j=1; j<size+1; j++) {
+    word_t * up = row(board, j-1);
+    word_t * mid = row(board, j);
+    word_t * down = row(board, j+1);
+    word_t * out = row(newboard, j);
+    for (w=1; w<=last; w++) {
+      word_t us, uc, ms, mc, ds, dc, s0, c0, ts, tc, next;
+      /* neighbours in the row above, the row itself and the row below */
+      ADD3(WEST(up, w), up[w], EAST(up, w), us, uc);
+      ms = WEST(mid, w) ^ EAST(mid, w);
+      mc = WEST(mid, w) & EAST(mid, w);
+      ADD3(WEST(down, w), down[w], EAST(down, w), ds, dc);
+      /* count = s0 + 2*(uc+mc+dc+c0); 2 or 3 neighbours means the twos add to 1 */
+      ADD3(us, ms, ds, s0, c0);
+      ADD3(uc, mc, dc, ts, tc);
+      next = ~tc & (ts ^ c0) & (s0 | mid[w]);
+      out[w] = w == last ? next & tail : next;
+    }
+  }
+}
+
+/* print the life board */
+void print (bitboard_t * board) {
+  output_t out;
+  int	j;
+  output_begin(&out, board->size);
+  for (j=0; j<board->size; j++)
+    output_bits(&out, row(board, j+1) + 1);
+  output_end(&out);
+}
+
+/* read a file into the life board */
+int read_file (board_text_t * text, bitboard_t * board) {
+  /* cell i of a file row is bit i of the packed row, so rows are packed
+   * 64 characters at a time */
+  return board_text_bits(text, row(board, 1) + 1, board->words);
+}
+
+/* hands the board to the snapshot writer when a snapshot is due */
+void snapshot (snapshots_t * snapshots, bitboard_t * board, long long generation) {
+  uint64_t * words = snapshot_take(snapshots, generation);
+  int j;
+  if (!words)
+    return;
+  /* the rows are packed already */
+  for (j=0; j<board->size; j++)
+    memcpy(words + (size_t)j*snapshots->words, row(board, j+1) + 1, snapshots->words * sizeof(word_t));
+  snapshot_give(snapshots);
+}
+
+int main () {
+  int size, steps;
+  board_text_t text;
+  if (board_text_open(stdin, &text))
+    return 1;
+  size = text.size;
+  steps = text.steps;
+  bitboard_t * prev = allocate_board (size);
+  if (read_file (&text, prev))
+    return 1;
+  board_text_close(&text);
+  bitboard_t * next = allocate_board (size);
+  bitboard_t * tmp;
+  int i;
+  #ifdef DEBUG
+  output_title("Initial:\n");
+  print(prev);
+  #endif
+
+  snapshots_t * snapshots = snapshots_start(size, steps);
+  snapshot(snapshots, prev, 0);
+  for (i=0; i<steps; i++) {
+    play (prev,next);
+    #ifdef DEBUG
+    output_title("%d ----------\n", i + 1);
+    print (next);
+    #endif
+    tmp = next;
+    next = prev;
+    prev = tmp;
+    snapshot(snapshots, prev, i + 1);
+  }
+  snapshots_finish(snapshots);
+
+#ifdef RESULT
+  output_title("Final:\n");
+  print (prev);
+#endif
+
+  free_board(prev);
+  free_board(next);
+}
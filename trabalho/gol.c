@@ -12,211 +12,248 @@
 * means on, space means off.
 *
 */
-#include <pthread.h>
-#include <semaphore.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <time.h>
 #include <sys/sysinfo.h>
+#include <string.h>
+#include "../board.h"
+#include "../deque.h"
+#include "../pool.h"
+#include "../stencil.h"
+#include "../temporal.h"
+#include "../generator.h"
+#include "../loader.h"
+#include "../output.h"
+#include "../snapshot.h"
 
-typedef unsigned char cell_t;
+/* the board is cut into TILE x TILE tiles that the threads take from
+ * work-stealing deques; a tile is only played when it or one of its
+ * neighbours changed in the last generation. With a depth above 1 every
+ * tile is advanced depth generations at a time (see temporal.h). */
+#define TILE 128
 
-cell_t ** allocate_board (int size) {
-  cell_t ** board = (cell_t **) malloc(sizeof(cell_t*)*size);
-  int	i;
-  for (i=0; i<size; i++)
-  board[i] = (cell_t *) malloc(sizeof(cell_t)*size);
-  return board;
+board_t * board;
+board_t * newboard;
+int size, steps;
+int generation;
+int depth;             /* generations per tile visit */
+int block;             /* generations in the current visit */
+play_row_t play_row;
+int tiles;             /* tiles per side */
+char * changed;        /* tiles that changed in the last generation */
+char * next_changed;   /* tiles that changed in this one */
+int * active;
+deque_t * deques;      /* one per thread */
+block_scratch_t * scratches;
+snapshots_t * snapshots;
+uint64_t * snapshot_words; /* the snapshot of this generation, while it is packed */
+
+void print (board_t * board);
+
+/* hands every thread a contiguous run of the tiles that have to be played */
+void schedule(int nthreads) {
+  int ti, tj, di, dj, t, n = 0;
+  for (ti = 0; ti < tiles; ++ti) {
+    for (tj = 0; tj < tiles; ++tj) {
+      int busy = 0;
+      for (di = ti-1; di <= ti+1 && !busy; ++di)
+        for (dj = tj-1; dj <= tj+1; ++dj)
+          if (di >= 0 && di < tiles && dj >= 0 && dj < tiles && changed[di*tiles+dj]) {
+            busy = 1;
+            break;
+          }
+      if (busy)
+        active[n++] = ti*tiles+tj;
+    }
+  }
+  memset(next_changed, 0, tiles*tiles);
+  for (t = 0; t < nthreads; ++t) {
+    int i;
+    deque_reset(&deques[t]);
+    for (i = (int)((long)n*t/nthreads); i < (int)((long)n*(t+1)/nthreads); ++i)
+      deque_push(&deques[t], active[i]);
+  }
 }
 
-void free_board (cell_t ** board, int size) {
-  int     i;
-  for (i=0; i<size; i++)
-  free(board[i]);
-  free(board);
+/* run by the last thread to finish a generation, before the others go on */
+void swap_boards(void * args) {
+  pool_t * pool = (pool_t *) args;
+  board_t * tmp;
+  char * c;
+  generation += block;
+  #ifdef DEBUG
+    output_title("%d ----------\n", generation);
+    print (newboard);
+  #endif
+  tmp = newboard;
+  newboard = board;
+  board = tmp;
+  c = next_changed;
+  next_changed = changed;
+  changed = c;
+  /* the threads packed the last snapshot before they got here */
+  if (snapshot_words)
+    snapshot_give(snapshots);
+  snapshot_words = snapshot_take(snapshots, generation);
+  /* a stable tile only stays stable over visits of the same length */
+  if (steps - generation < block) {
+    block = steps - generation;
+    memset(changed, 1, tiles*tiles);
+  }
+  schedule(pool->nthreads);
 }
 
-/* return the number of on cells adjacent to the i,j cell */
-inline int adjacent_to (cell_t ** board, int size, int i, int j) {
-  int count = 0;
-  count+=board[i-1][j-1];
-  count+=board[i-1][j];
-  count+=board[i-1][j+1];
-  count+=board[i][j-1];
-  count+=board[i][j+1];
-  count+=board[i+1][j-1];
-  count+=board[i+1][j];
-  count+=board[i+1][j+1];
-  return count;
+/* plays one tile and records whether any of its cells changed */
+void play_tile(int t, block_scratch_t * scratch) {
+  int i;
+  int i0 = t / tiles * TILE, j0 = t % tiles * TILE;
+  int i1 = i0 + TILE < size ? i0 + TILE : size;
+  int width = j0 + TILE < size ? TILE : size - j0;
+  int diff = 0;
+  if (block > 1) {
+    next_changed[t] = play_block(board, newboard, i0, i1, j0, j0 + width, block, scratch, play_row) != 0;
+    return;
+  }
+  for (i = i0; i<i1; ++i) {
+    cell_t * mid = board_row(board, i) + j0;
+    cell_t * out = board_row(newboard, i) + j0;
+    play_row(mid - board->stride, mid, mid + board->stride, out, width);
+    if (!diff)
+      diff = memcmp(out, mid, width);
+  }
+  next_changed[t] = diff != 0;
 }
 
-cell_t ** board;
-cell_t ** newboard;
-sem_t *producer_sem1;
-sem_t *producer_sem2;
-sem_t *consumer_sem;
+/* packs this thread's share of the rows of the snapshot; board is only
+ * read while the generation is played, so the rows are packed meanwhile */
+void pack_snapshot(int thread_number, int nthreads) {
+  int j;
+  for (j = (int)((long)size*thread_number/nthreads); j < (int)((long)size*(thread_number+1)/nthreads); ++j)
+    snapshot_cells(snapshots, snapshot_words, j, board_row(board, j), 1);
+}
 
-void *play(void *args) {
-  int i, j, a;
-  int thread_number = *((int *) args);
-  int size = ((int*)args)[1];
-  int steps = ((int*)args)[2];
-  int nthreads = ((int*)args)[3];
-  cell_t** b = board;
-  cell_t** nb = newboard;
-  sem_t *temp = producer_sem1;
-  /* for each cell, apply the rules of Life */
-  int maxi = (int)(size/(double)nthreads*(thread_number+1));
-  int mini = (int)(size/(double)nthreads*thread_number);
-  //printf("start: %d finish: %d size: %d\n", mini, maxi, size);
-  for (int k=0; k<steps; k++) {
-    sem_wait(temp);
-    b = board;
-    nb = newboard;
-    for (i = mini+1; i<maxi+1; ++i) {
-      for (j= 1; j<size+1; j++) {
-        a = adjacent_to(b, size, i, j);
-        if (a == 2) {
-          nb[i][j] = b[i][j];
-        } else if (a == 3) {
-          nb[i][j] = 1 ;
-        } else {
-          nb[i][j] = 0;
-        }
+void play(pool_t * pool, int thread_number, void * args) {
+  int v, t, busy;
+  int nthreads = pool->nthreads;
+  block_scratch_t * scratch = &scratches[thread_number];
+  for (;;) {
+    if (snapshot_words)
+      pack_snapshot(thread_number, nthreads);
+    if (generation >= steps)
+      break;
+    /* first our own tiles, then whatever the others did not get to yet */
+    while ((t = deque_pop(&deques[thread_number])) != DEQUE_EMPTY)
+      play_tile(t, scratch);
+    do {
+      busy = 0;
+      for (v = 1; v < nthreads; ++v) {
+        t = deque_steal(&deques[(thread_number+v) % nthreads]);
+        if (t >= 0)
+          play_tile(t, scratch);
+        if (t != DEQUE_EMPTY)
+          busy = 1;
       }
-    }
-    if (temp == producer_sem2){
-      temp = producer_sem1;
-    } else {
-      temp = producer_sem2;
-    }
-    sem_post(consumer_sem);
+    } while (busy);
+    pool_barrier(pool, thread_number, swap_boards, pool);
   }
 }
 
 /* print the life board */
-void print (cell_t ** board, int size) {
-  int	i, j;
-  /* for each row */
-  for (j=1; j<size+1; j++) {
-    /* print each column position... */
-    for (i=1; i<size+1; i++)
-      if(board[i][j]){
-          printf ("■ ");
-      } else {
-        printf ("  ");
-      }
-    /* followed by a carriage return */
-    printf ("\n");
-  }
+void print (board_t * board) {
+  output_t out;
+  int	j;
+  output_begin(&out, board->size);
+  for (j=0; j<board->size; j++)
+    output_cells(&out, board_row(board, j), 1);
+  output_end(&out);
 }
 
-/* read a file into the life board */
-void read_file (FILE * f, cell_t ** board, int size) {
-  int	i, j;
-  char	*s = (char *) malloc(size+10);
-
-  /* read the first new line (it will be ignored) */
-  fgets (s, size+10,f);
-
-  /* read the life board */
-  for (j=0; j<size; j++) {
-    /* get a string */
-    fgets (s, size+10,f);
-    /* copy the string to the life board */
-    for (i=0; i<size; i++)
-    board[i+1][j+1] = s[i] == 'x';
-  }
-  for (i=0; j<size+2; i++) {
-    board[0][j] = 0;
-    board[j][size+1] = 0;
-    board[size+1][j] = 0;
-    board[j][size+1] = 0;
-  }
-
+/* read a file into the life board, row j of the file in row j of the board */
+int read_file (board_text_t * text, board_t * board) {
+  return board_text_cells(text, board_row(board, 0), board->stride, 1);
 }
 
-void fill_board(cell_t ** board, int size, int percentage_alive) {
+void fill_board(board_t * board, int percentage_alive) {
   int	i, j;
-  srand(time(NULL));
-  for (j=1; j<size+1; j++) {
-    for (i=1; i<size+1; i++){
-	    board[i][j] = ((int)(rand()) %percentage_alive == 0? 1 : 0 );
+  uint64_t seed = board_seed();
+  for (j=0; j<board->size; j++) {
+    for (i=0; i<board->size; i++){
+	    CELL(board, j, i) = random_cell(seed, i, j, 1.0/percentage_alive);
     }
   }
 }
 
+/* usage: ./gol nthreads [depth] < input */
 int main(int argc, char**argv){
-int size, steps;
   //if (argc<2 || atoi(argv[1])){
-    FILE    *f;
-    f = stdin;
-    fscanf(f,"%d %d", &size, &steps);
-    board = allocate_board (size+2);
-    read_file (f, board,size);
-    fclose(f);
-    newboard = allocate_board (size+2);
+    board_text_t text;
+    if (board_text_open(stdin, &text))
+      return 1;
+    size = text.size;
+    steps = text.steps;
+    board = allocate_board (size);
+    if (read_file (&text, board))
+      return 1;
+    board_text_close(&text);
+    newboard = allocate_board (size);
   /*} else {
     steps = 1000;
     size = 1000;
-    board = allocate_board (size+2);
-    newboard = allocate_board (size+2);
-    fill_board(board, size, 32);
+    board = allocate_board (size);
+    newboard = allocate_board (size);
+    fill_board(board, 32);
   }
   /**/
-  sem_t p_sem1;
-  sem_t p_sem2;
-  sem_t* prod_sem = &p_sem2;
-  sem_t c_sem;
-  cell_t ** tmp;
+  pool_t pool;
   int i;
   #ifdef DEBUG
-    printf("Initial:\n");
-    print(board,size);
+    output_title("Initial:\n");
+    print(board);
+    printf ("You have %d processors.\n", get_nprocs());
   #endif
-   printf ("You have %d processors.\n", get_nprocs());
   int nthreads = atoi(argv[1]);
-  pthread_t* threads= malloc(nthreads*sizeof(pthread_t));
-  sem_init(&p_sem1, 0, nthreads);
-  sem_init(&p_sem2, 0, 0);
-  sem_init(&c_sem, 0, 0);
-  producer_sem1 = &p_sem1;
-  producer_sem2 = &p_sem2;
-  consumer_sem = &c_sem;
-  for (int j = 0; j<nthreads; j++){
-    int *i = malloc(sizeof(*i)*4);
-    i[0] = j;
-    i[1] = size;
-    i[2] = steps;
-    i[3] = nthreads;
-    pthread_create(&threads[j], NULL, play, (void *)i);
+  /* past one tile a change could reach tiles that are not its neighbours */
+  depth = argc > 2 ? atoi(argv[2]) : 1;
+  depth = depth < 1 ? 1 : depth > TILE ? TILE : depth;
+  block = depth < steps ? depth : steps;
+  play_row = select_play_row();
+  tiles = (size + TILE - 1) / TILE;
+  changed = (char *) malloc(tiles*tiles);
+  next_changed = (char *) malloc(tiles*tiles);
+  active = (int *) malloc(tiles*tiles*sizeof(int));
+  deques = (deque_t *) malloc(nthreads*sizeof(deque_t));
+  scratches = (block_scratch_t *) malloc(nthreads*sizeof(block_scratch_t));
+  for (i = 0; i < nthreads; ++i) {
+    deque_init(&deques[i], tiles*tiles);
+    block_scratch_init(&scratches[i], TILE, depth);
   }
-  for (i=0; i<steps; i++) {
-    for (int j = 0; j<nthreads; j++){
-      sem_wait(consumer_sem);
-    }
-    #ifdef DEBUG
-      printf("%d ----------\n", i + 1);
-      print (newboard,size);
-    #endif
-    tmp = newboard;
-    newboard = board;
-    board = tmp;
-    for (int j = 0; j<nthreads; j++){
-      sem_post(prod_sem);
-    }
-    if (prod_sem == producer_sem2){
-      prod_sem = producer_sem1;
-    } else {
-      prod_sem = producer_sem2;
-    }
+  /* everything is new in the first generation */
+  memset(changed, 1, tiles*tiles);
+  schedule(nthreads);
+  snapshots = snapshots_start(size, steps);
+  snapshot_words = snapshot_take(snapshots, 0);
+  pool_init(&pool, nthreads);
+  pool_run(&pool, play, NULL);
+  pool_destroy(&pool);
+  /* the threads packed the one of the last generation on their way out */
+  if (snapshot_words)
+    snapshot_give(snapshots);
+  snapshots_finish(snapshots);
+  for (i = 0; i < nthreads; ++i) {
+    deque_free(&deques[i]);
+    block_scratch_free(&scratches[i]);
   }
+  free(deques);
+  free(scratches);
+  free(active);
+  free(changed);
+  free(next_changed);
 
   #ifdef RESULT
-    printf("Final:\n");
-    print (board,size);
+    output_title("Final:\n");
+    print (board);
   #endif
 
-  free_board(newboard,size);
-  free_board(board,size);
+  free_board(newboard);
+  free_board(board);
 }
@@ -14,119 +14,113 @@
 */
 #include <stdio.h>
 #include <stdlib.h>
+#include "../board.h"
+#include "../stencil.h"
+#include "../temporal.h"
+#include "../loader.h"
+#include "../output.h"
+#include "../snapshot.h"
 
-typedef unsigned char cell_t;
+/* tiles advanced several generations at once when a depth is given */
+#define TILE 256
 
-cell_t ** allocate_board (int size) {
-  cell_t ** board = (cell_t **) malloc(sizeof(cell_t*)*size);
-  int	i;
-  for (i=0; i<size; i++)
-  board[i] = (cell_t *) malloc(sizeof(cell_t)*size);
-  return board;
-}
-
-void free_board (cell_t ** board, int size) {
-  int     i;
-  for (i=0; i<size; i++)
-  free(board[i]);
-  free(board);
-}
+play_row_t play_row;
 
-
-/* return the number of on cells adjacent to the i,j cell */
-int adjacent_to (cell_t ** board, int size, int i, int j) {
-  int count = 0;
-  count+=board[i-1][j-1];
-  count+=board[i-1][j];
-  count+=board[i-1][j+1];
-  count+=board[i][j-1];
-  count+=board[i][j+1];
-  count+=board[i+1][j-1];
-  count+=board[i+1][j];
-  count+=board[i+1][j+1];
-  return count;
+void play (board_t * board, board_t * newboard) {
+  int	i;
+  /* for each row, apply the rules of Life */
+  for (i=0; i<board->size; i++)
+    play_row(board_row(board, i-1), board_row(board, i), board_row(board, i+1),
+             board_row(newboard, i), board->size);
 }
 
-void play (cell_t ** board, cell_t ** newboard, int size) {
-  int	i, j, a;
-  /* for each cell, apply the rules of Life */
-  for (i=1; i<size+1; i++)
-    for (j=1; j<size+1; j++) {
-    a = adjacent_to (board, size, i, j);
-    if (a == 2){
-      newboard[i][j] = board[i][j];
-    } else if (a == 3) {
-      newboard[i][j] = 1 ;
-    } else {
-      newboard[i][j] = 0;
-    }
-  }
+/* advance the board depth generations, one tile at a time */
+void play_blocked (board_t * board, board_t * newboard, int depth, block_scratch_t * scratch) {
+  int	i, j;
+  int size = board->size;
+  for (i=0; i<size; i+=TILE)
+    for (j=0; j<size; j+=TILE)
+      play_block(board, newboard, i, min_int(i+TILE, size), j, min_int(j+TILE, size),
+                 depth, scratch, play_row);
 }
 
 /* print the life board */
-void print (cell_t ** board, int size) {
-  int	i, j;
-  /* for each row */
-  for (j=1; j<size+1; j++) {
-    /* print each column position... */
-    for (i=1; i<size+1; i++)
-    printf ("%ls", board[i][j] ? '■' : '□');
-    /* followed by a carriage return */
-    printf ("\n");
-  }
+void print (board_t * board) {
+  output_t out;
+  int	j;
+  output_begin(&out, board->size);
+  for (j=0; j<board->size; j++)
+    output_cells(&out, board_row(board, j), 1);
+  output_end(&out);
 }
 
-/* read a file into the life board */
-void read_file (FILE * f, cell_t ** board, int size) {
-  int	i, j;
-  char	*s = (char *) malloc(size+10);
-
-  /* read the first new line (it will be ignored) */
-  fgets (s, size+10,f);
-
-  /* read the life board */
-  for (j=0; j<size; j++) {
-    /* get a string */
-    fgets (s, size+10,f);
-    /* copy the string to the life board */
-    for (i=0; i<size; i++)
-    board[i+1][j+1] = s[i] == 'x';
+/* read a file into the life board, row j of the file in row j of the board */
+int read_file (board_text_t * text, board_t * board) {
+  return board_text_cells(text, board_row(board, 0), board->stride, 1);
+}
 
-  }
+/* hands the board to the snapshot writer when a snapshot is due */
+void snapshot (snapshots_t * snapshots, board_t * board, long long generation) {
+  uint64_t * words = snapshot_take(snapshots, generation);
+  int j;
+  if (!words)
+    return;
+  for (j=0; j<board->size; j++)
+    snapshot_cells(snapshots, words, j, board_row(board, j), 1);
+  snapshot_give(snapshots);
 }
 
-int main () {
+/* usage: ./sequencial [depth] < input
+ * depth > 1 advances each tile depth generations while it stays in cache */
+int main (int argc, char **argv) {
   int size, steps;
-  FILE    *f;
-  f = stdin;
-  fscanf(f,"%d %d", &size, &steps);
-  cell_t ** prev = allocate_board (size+2);
-  read_file (f, prev,size);
-  fclose(f);
-  cell_t ** next = allocate_board (size+2);
-  cell_t ** tmp;
-  int i;
+  int depth = argc > 1 ? atoi(argv[1]) : 1;
+  block_scratch_t scratch;
+  board_text_t text;
+  play_row = select_play_row();
+  if (board_text_open(stdin, &text))
+    return 1;
+  size = text.size;
+  steps = text.steps;
+  board_t * prev = allocate_board (size);
+  if (read_file (&text, prev))
+    return 1;
+  board_text_close(&text);
+  board_t * next = allocate_board (size);
+  board_t * tmp;
+  int i, block;
+  depth = depth < 1 ? 1 : depth > TILE ? TILE : depth;
+  block_scratch_init(&scratch, TILE, depth);
+  snapshots_t * snapshots = snapshots_start(size, steps);
+  snapshot(snapshots, prev, 0);
   #ifdef DEBUG
-  printf("Initial:\n");
-  print(prev,size);
+  output_title("Initial:\n");
+  print(prev);
   #endif
 
-  for (i=0; i<steps; i++) {
-    play (prev,next,size);
+  for (i=0; i<steps; i+=block) {
+    block = min_int(depth, steps - i);
+    if (block == 1)
+      play (prev,next);
+    else
+      play_blocked (prev,next,block,&scratch);
     #ifdef DEBUG
-    printf("%d ----------\n", i + 1);
-    print (next,size);
+    output_title("%d ----------\n", i + block);
+    print (next);
     #endif
     tmp = next;
     next = prev;
     prev = tmp;
+    snapshot(snapshots, prev, i + block);
   }
+  snapshots_finish(snapshots);
 
 #ifdef RESULT
-  printf("Final:\n");
-  print (prev,size);
+  output_title("Final:\n");
+  print (prev);
 #endif
 
-  free_board(prev,size);
-  free_board(next,size);
+  block_scratch_free(&scratch);
+  free_board(prev);
+  free_board(next);
 }
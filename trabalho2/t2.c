@@ -17,199 +17,468 @@
 #include <time.h>
 #include <sys/sysinfo.h>
 #include <unistd.h>
+#include <string.h>
 #include <mpi.h>
-
-typedef unsigned char cell_t;
+#include "../board.h"
+#include "../pool.h"
+#include "../loader.h"
+#include "../output.h"
 
 /* ------------------------------------------------------------------------- */
 
-cell_t ** allocate_board (int size) {
-  cell_t ** board = (cell_t **) (malloc(sizeof(cell_t*)*size+2))+1;
-  int   i;
-  for (i=-1; i<size+1; i++)
-    board[i] = (cell_t *) (malloc(sizeof(cell_t)*size+2))+1;
-  return board;
+/* return the number of on cells adjacent to cell j of the row mid */
+static inline int adjacent_to(const cell_t * up, const cell_t * mid, const cell_t * down, int j) {
+   int count = 0;
+   count+=up[j-1];
+   count+=up[j];
+   count+=up[j+1];
+   count+=mid[j-1];
+   count+=mid[j+1];
+   count+=down[j-1];
+   count+=down[j];
+   count+=down[j+1];
+   return count;
 }
 
 /* ------------------------------------------------------------------------- */
 
-void free_board (cell_t ** board, int size) {
-  int     i;
-  for (i=0; i<size; i++)
-    free(board[i]);
-  free(board);
+/* apply the rules of Life to rows [i0, i1) x columns [j0, j1) */
+void play_rows (board_t * board, board_t * newboard, int i0, int i1, int j0, int j1) {
+  int i, j;
+  for (i = i0; i<i1; ++i) {
+    cell_t * up = board_row(board, i-1);
+    cell_t * mid = board_row(board, i);
+    cell_t * down = board_row(board, i+1);
+    cell_t * out = board_row(newboard, i);
+    for (j= j0; j<j1; j++) {
+      int a = adjacent_to(up, mid, down, j);
+      if (a == 2) {
+        out[j] = mid[j];
+      } else if (a == 3) {
+        out[j] = 1 ;
+      } else {
+        out[j] = 0;
+      }
+    }
+  }
 }
 
 /* ------------------------------------------------------------------------- */
 
-/* return the number of on cells adjacent to the i,j cell */
- inline int adjacent_to(cell_t ** board, int i, int j) {
-   int count = 0;
-   count+=board[i-1][j-1];
-   count+=board[i-1][j];
-   count+=board[i-1][j+1];
-   count+=board[i][j-1];
-   count+=board[i][j+1];
-   count+=board[i+1][j-1];
-   count+=board[i+1][j];
-   count+=board[i+1][j+1];
-   return count;
+/* the board is cut in a dims[0] x dims[1] grid of blocks, one per worker;
+ * with one column of blocks they are the old slabs of rows */
+
+/* the rows (or columns) [*lo, *hi) of block n out of parts */
+static void split (int size, int parts, int n, int * lo, int * hi) {
+  *lo = (int)(size/(double)parts*n);
+  *hi = (int)(size/(double)parts*(n+1));
+}
+
+/* the rank of the block at (di, dj) from coords, or MPI_PROC_NULL past the edge */
+static int neighbour (MPI_Comm grid, const int * dims, const int * coords, int di, int dj) {
+  int at[2] = {coords[0] + di, coords[1] + dj}, n;
+  if (at[0] < 0 || at[0] >= dims[0] || at[1] < 0 || at[1] >= dims[1])
+    return MPI_PROC_NULL;
+  MPI_Cart_rank(grid, at, &n);
+  return n;
 }
 
 /* ------------------------------------------------------------------------- */
 
 /* print the life board */
-void print (cell_t ** board, int size) {
-  int   i, j;
-  /* for each row */
-  for (j=0; j<size; j++) {
-    /* print each column position... */
-    for (i=0; i<size; i++)
-      if(board[i][j]){
-          printf ("■ ");
-      } else {
-        printf ("  ");
-      }
-    /* followed by a carriage return */
-    printf ("\n");
+void print (board_t * board) {
+  output_t out;
+  int	j;
+  output_begin(&out, board->size);
+  for (j=0; j<board->size; j++)
+    output_cells(&out, board_row(board, j), 1);
+  output_end(&out);
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* read a file into the life board, row j of the file in row j of the board */
+int read_file (board_text_t * text, board_t * board) {
+  return board_text_cells(text, board_row(board, 0), board->stride, 1);
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* binary boards: three native ints (BOARD_MAGIC, size and the generations
+ * still to play) and then size*size bytes, one per cell, row after row.
+ * Every rank reads and writes only its own block, all at the same time. */
+
+#define BOARD_MAGIC 0x424c4f47  /* "GOLB" */
+#define HEADER_BYTES (3*sizeof(int))
+
+static MPI_File open_board (const char * path, int mode) {
+  MPI_File file;
+  if (MPI_File_open(MPI_COMM_WORLD, (char *) path, mode, MPI_INFO_NULL, &file) != MPI_SUCCESS) {
+    fprintf(stderr, "cannot open %s\n", path);
+    MPI_Abort(MPI_COMM_WORLD, 1);
   }
+  return file;
+}
+
+static void read_header (MPI_File file, const char * path, int * size, int * steps) {
+  int header[3];
+  MPI_File_read_at_all(file, 0, header, 3, MPI_INT, MPI_STATUS_IGNORE);
+  if (header[0] != BOARD_MAGIC) {
+    fprintf(stderr, "%s is not a binary board\n", path);
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  *size = header[1];
+  *steps = header[2];
+}
+
+/* reads or writes the cells [mini, mini+rows) x [minj, minj+cols) of local */
+static void transfer_block (MPI_File file, board_t * local, int size, int mini, int minj, int write) {
+  int sizes[2] = {size, size}, subsizes[2] = {local->rows, local->size}, starts[2] = {mini, minj};
+  MPI_Datatype filetype, memtype;
+  MPI_Type_create_subarray(2, sizes, subsizes, starts, MPI_ORDER_C, MPI_CHAR, &filetype);
+  MPI_Type_commit(&filetype);
+  MPI_Type_vector(local->rows, local->size, local->stride, MPI_CHAR, &memtype);
+  MPI_Type_commit(&memtype);
+  MPI_File_set_view(file, HEADER_BYTES, MPI_CHAR, filetype, "native", MPI_INFO_NULL);
+  if (write)
+    MPI_File_write_at_all(file, 0, board_row(local, 0), 1, memtype, MPI_STATUS_IGNORE);
+  else
+    MPI_File_read_at_all(file, 0, board_row(local, 0), 1, memtype, MPI_STATUS_IGNORE);
+  MPI_File_set_view(file, 0, MPI_BYTE, MPI_BYTE, "native", MPI_INFO_NULL);
+  MPI_Type_free(&filetype);
+  MPI_Type_free(&memtype);
+}
+
+/* writes the board to path with steps generations left; the file is written
+ * under another name and renamed, so a crash never leaves half a checkpoint */
+static void save_board (const char * path, board_t * local, int size, int steps, int mini, int minj) {
+  int rank, header[3] = {BOARD_MAGIC, size, steps};
+  char * partial = (char *) malloc(strlen(path) + 9);
+  MPI_File file;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  sprintf(partial, "%s.partial", path);
+  file = open_board(partial, MPI_MODE_CREATE | MPI_MODE_WRONLY);
+  MPI_File_set_size(file, HEADER_BYTES + (MPI_Offset)size*size);
+  MPI_File_write_at_all(file, 0, header, rank == 0 ? 3 : 0, MPI_INT, MPI_STATUS_IGNORE);
+  transfer_block(file, local, size, mini, minj, 1);
+  MPI_File_close(&file);
+  if (rank == 0 && rename(partial, path))
+    perror(path);
+  free(partial);
 }
 
 /* ------------------------------------------------------------------------- */
 
-/* read a file into the life board */
-void read_file (FILE * f, cell_t ** board, int size) {
-  int   i, j;
-  char  *s = (char *) malloc(size+10);
+/* the block of this rank and what the threads of its pool share while they
+ * play it. Only thread 0, the one that called MPI_Init_thread, talks to MPI
+ * (MPI_THREAD_FUNNELED): it posts the halo exchange, waits for it and plays
+ * the outer ring of the block, while the other threads take chunks of the
+ * interior rows. */
+
+#define CHUNK_ROWS 16
 
-  /* read the first new line (it will be ignored) */
-  fgets (s, size+10,f);
-  /* read the life board */
-  for (j=0; j<size; j++) {
-    /* get a string */
-    fgets (s, size+10,f);
-    /* copy the string to the life board */
-    for (i=0; i<size; i++)
-    board[i][j] = s[i] == 'x';
+static int size, steps, generation;
+static int input_steps;     /* the generations the input asks for, whatever -g says */
+static board_t * local;
+static board_t * newlocal;
+static int rows, cols, mini, minj;
+static MPI_Comm grid;
+static int neighbours[9];
+static MPI_Datatype types[9];
+static atomic_int next_chunk;
+static const char * out_path = NULL;
+static int every = 0;
+
+/* posts the exchange of the halos of the current generation */
+static int post_halos (MPI_Request * requests) {
+  int n = 0;
+  // a mensagem enviada na direção d chega ao vizinho pela direção oposta, 8-d
+  for (int d = 0; d < 9; ++d) {
+    int di = d/3 - 1, dj = d%3 - 1;
+    if (neighbours[d] == MPI_PROC_NULL)
+      continue;
+    MPI_Irecv(board_row(local, di < 0 ? -1 : di > 0 ? rows : 0) + (dj < 0 ? -1 : dj > 0 ? cols : 0),
+              1, types[d], neighbours[d], 8-d, grid, &requests[n++]);
+    MPI_Isend(board_row(local, di > 0 ? rows-1 : 0) + (dj > 0 ? cols-1 : 0),
+              1, types[d], neighbours[d], d, grid, &requests[n++]);
+  }
+  return n;
+}
+
+/* the outer ring of the block, which depends on the halos */
+static void play_ring (void) {
+  play_rows(local, newlocal, 0, 1, 0, cols);
+  if (rows > 1)
+    play_rows(local, newlocal, rows-1, rows, 0, cols);
+  if (rows > 2) {
+    play_rows(local, newlocal, 1, rows-1, 0, 1);
+    if (cols > 1)
+      play_rows(local, newlocal, 1, rows-1, cols-1, cols);
   }
+}
 
-  for (j=-1; j<size+1; j++) {
-    board[-1][j] = 0;
-    board[j][size] = 0;
-    board[size][j] = 0;
-    board[j][-1] = 0;
+/* takes chunks of the interior until there are none left */
+static void play_interior (void) {
+  int c, nchunks = (rows - 2 + CHUNK_ROWS - 1) / CHUNK_ROWS;
+  if (rows <= 2 || cols <= 2)
+    return;
+  while ((c = atomic_fetch_add(&next_chunk, 1)) < nchunks) {
+    int i0 = 1 + c*CHUNK_ROWS;
+    int i1 = i0 + CHUNK_ROWS < rows-1 ? i0 + CHUNK_ROWS : rows-1;
+    play_rows(local, newlocal, i0, i1, 1, cols-1);
   }
+}
 
+/* what a board written now has left to play */
+static int steps_left (void) {
+  return input_steps > generation ? input_steps - generation : 0;
 }
 
- inline void get_next_state(cell_t** board, cell_t** newboard, int i, int j){
-  int a = adjacent_to(board, i, j);
-  if (a == 2) {
-    newboard[i][j] = board[i][j];
-  } else if (a == 3) {
-    newboard[i][j] = 1 ;
-  } else {
-    newboard[i][j] = 0;
+/* run by the last thread to finish a generation, before the others go on */
+static void swap_blocks (void * arg) {
+  board_t * tmp = newlocal;
+  newlocal = local;
+  local = tmp;
+  generation++;
+  atomic_store(&next_chunk, 0);
+}
+
+void play (pool_t * pool, int thread_number, void * arg) {
+  MPI_Request requests[16];
+  while (generation < steps) {
+    if (thread_number == 0) {
+      // o checkpoint só lê o bloco, enquanto as outras threads escrevem no novo
+      if (out_path && every > 0 && generation > 0 && generation % every == 0)
+        save_board(out_path, local, size, steps_left(), mini, minj);
+      int n = post_halos(requests);
+      // sozinha, a thread 0 calcula o interior enquanto as bordas viajam
+      if (pool->nthreads == 1)
+        play_interior();
+      MPI_Waitall(n, requests, MPI_STATUSES_IGNORE);
+      play_ring();
+    }
+    play_interior();
+    pool_barrier(pool, thread_number, swap_blocks, NULL);
   }
 }
 
 /* ------------------------------------------------------------------------- */
 
+// usage: mpirun -np N ./t2exe [1d|2d] [-r board] [-w board [-c every]] [-g steps] [< input]
+// 1d (o padrão) divide o quadro em faixas de linhas, 2d em blocos numa grade
+// cartesiana de processos, que trocam menos bordas quando há muitos processos.
+// -r lê um quadro binário com MPI-IO em vez do quadro texto da entrada padrão,
+// -w escreve o quadro final em binário em vez de imprimi-lo, e com -c também
+// a cada every gerações (o arquivo guarda quantas das gerações da entrada
+// faltam, então -r o retoma).
+// -g troca o número de gerações; -g 0 -w converte um quadro texto em binário.
+// -t divide o bloco de cada processo entre threads, para usar um processo por
+// nó (ou por soquete) em vez de um por núcleo.
 int main(int argc, char**argv){
 
-  MPI_Init(&argc, &argv);
-  int size, steps;
-  cell_t ** board;
-  cell_t ** newboard;
+  int provided;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+  board_t * board = NULL;
+  const char * in_path = NULL;
+  int forced_steps = -1, nthreads = 1, opt;
+  MPI_File in_file;
+  pool_t pool;
 
     int world_size;
     MPI_Comm_size( MPI_COMM_WORLD, &world_size);
     int rank;
     MPI_Comm_rank( MPI_COMM_WORLD, &rank);
-  if (rank ==0){
-
-      FILE    *f;
-      f = stdin;
-      fscanf(f,"%d %d", &size, &steps);
+  while ((opt = getopt(argc, argv, "r:w:c:g:t:")) != -1) {
+    switch (opt) {
+      case 'r': in_path = optarg; break;
+      case 'w': out_path = optarg; break;
+      case 'c': every = atoi(optarg); break;
+      case 'g': forced_steps = atoi(optarg); break;
+      case 't': nthreads = atoi(optarg) > 0 ? atoi(optarg) : 1; break;
+      default:
+        MPI_Finalize();
+        return 2;
+    }
+  }
+  if (in_path){
+      //cada rank lê só o seu bloco, mais abaixo
+      in_file = open_board(in_path, MPI_MODE_RDONLY);
+      read_header(in_file, in_path, &size, &steps);
+  } else if (rank ==0){
+      //só o rank 0 lê o arquivo; ele também calcula o seu bloco
+      board_text_t text;
+      if (board_text_open(stdin, &text))
+        MPI_Abort(MPI_COMM_WORLD, 1);
+      size = text.size;
+      steps = text.steps;
       board = allocate_board (size);
-      read_file (f, board, size);
-      fclose(f);
-      newboard = allocate_board (size);
+      if (read_file (&text, board))
+        MPI_Abort(MPI_COMM_WORLD, 1);
+      board_text_close(&text);
+  }
+  if (nthreads > 1 && provided < MPI_THREAD_FUNNELED) {
+    if (rank == 0)
+      fprintf(stderr, "this MPI has no MPI_THREAD_FUNNELED, running with one thread\n");
+    nthreads = 1;
   }
-  cell_t ** tmp;
-  int i;
+  //os snapshots de snapshot.h precisariam juntar o quadro a cada geração; -w -c faz o checkpoint
+  if (rank == 0 && (getenv("GOL_SNAPSHOT_EVERY") || getenv("GOL_TRACE")))
+    fprintf(stderr, "t2exe writes no snapshots or traces, GOL_SNAPSHOT_EVERY and GOL_TRACE are ignored (use -w -c)\n");
   #ifdef DEBUG
-    printf("Initial:\n");
-    //print(board,size);
+    if (rank == 0 && board) {
+      output_title("Initial:\n");
+      print(board);
+    }
   #endif
 
-  //como o  rank 0 é o processo principal, os ranks começam do 1 o process_number é o rank-1
-  int process_number = rank-1;
-  world_size--;
-  //se for o processo inicial, não faz os calculos, apenas aguarda finalizarem
   MPI_Bcast(&size, 1, MPI_INT, 0, MPI_COMM_WORLD);
   MPI_Bcast(&steps, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  input_steps = steps;
+  if (forced_steps >= 0)
+    steps = forced_steps;
+
+  //a grade de blocos: uma coluna de faixas, ou o que MPI_Dims_create achar mais quadrado
+  int dims[2] = {world_size, 1};
+  int periods[2] = {0, 0};
+  if (optind < argc && !strcmp(argv[optind], "2d")) {
+    dims[0] = dims[1] = 0;
+    MPI_Dims_create(world_size, 2, dims);
+  }
+  if (dims[0] > size || dims[1] > size) {
+    if (rank == 0)
+      fprintf(stderr, "%d processes do not fit in a %dx%d board\n", world_size, size, size);
+    MPI_Finalize();
+    return 1;
+  }
+
+  //sem reordenar, o rank na grade é o mesmo e o rank 0 fica com o bloco (0, 0)
+  MPI_Comm grid_row, grid_column;
+  int coords[2], maxi, maxj;
+  int keep_row[2] = {0, 1}, keep_column[2] = {1, 0};
+  MPI_Cart_create(MPI_COMM_WORLD, 2, dims, periods, 0, &grid);
+  MPI_Cart_coords(grid, rank, 2, coords);
+  MPI_Cart_sub(grid, keep_row, &grid_row);
+  MPI_Cart_sub(grid, keep_column, &grid_column);
+  split(size, dims[0], coords[0], &mini, &maxi);
+  split(size, dims[1], coords[1], &minj, &maxj);
+  rows = maxi - mini;
+  cols = maxj - minj;
+  local = allocate_rect (rows, cols);
+  newlocal = allocate_rect (rows, cols);
+
+  //as linhas e colunas de cada bloco, para Scatterv e Gatherv
+  int * counts = (int *) malloc(world_size*sizeof(int));
+  int * displs = (int *) malloc(world_size*sizeof(int));
+  //a faixa de linhas da grade: quem está na primeira coluna da grade recebe a
+  //faixa inteira e a reparte com os outros da sua linha da grade
+  board_t * slab = dims[1] == 1 ? local :
+                   coords[1] == 0 && (!in_path || !out_path) ? allocate_rect (rows, size) : NULL;
+  MPI_Datatype full_row, slab_column, local_column;
+  MPI_Datatype row_type, column_type;
+  MPI_Type_contiguous(size, MPI_CHAR, &row_type);
+  MPI_Type_create_resized(row_type, 0, board_stride(size), &full_row);
+  MPI_Type_commit(&full_row);
+  MPI_Type_free(&row_type);
+  //uma coluna do bloco, com extensão de uma célula para que os deslocamentos contem colunas
+  MPI_Type_vector(rows, 1, board_stride(size), MPI_CHAR, &column_type);
+  MPI_Type_create_resized(column_type, 0, 1, &slab_column);
+  MPI_Type_commit(&slab_column);
+  MPI_Type_free(&column_type);
+  MPI_Type_vector(rows, 1, local->stride, MPI_CHAR, &column_type);
+  MPI_Type_create_resized(column_type, 0, 1, &local_column);
+  MPI_Type_commit(&local_column);
+  MPI_Type_free(&column_type);
+
+  if (in_path) {
+    transfer_block(in_file, local, size, mini, minj, 0);
+    MPI_File_close(&in_file);
+  } else if (coords[1] == 0) {
+    for (int r = 0; r < dims[0]; ++r) {
+      int lo, hi;
+      split(size, dims[0], r, &lo, &hi);
+      counts[r] = hi - lo;
+      displs[r] = lo;
+    }
+    MPI_Scatterv(rank == 0 ? board_row(board, 0) : NULL, counts, displs, full_row,
+                 board_row(slab, 0), rows, full_row, 0, grid_column);
+  }
+  if (!in_path && dims[1] > 1) {
+    for (int c = 0; c < dims[1]; ++c) {
+      int lo, hi;
+      split(size, dims[1], c, &lo, &hi);
+      counts[c] = hi - lo;
+      displs[c] = lo;
+    }
+    MPI_Scatterv(slab ? board_row(slab, 0) : NULL, counts, displs, slab_column,
+                 board_row(local, 0), cols, local_column, 0, grid_row);
+  }
+
+  //as bordas de cima e de baixo são linhas, as dos lados colunas, e os cantos uma célula
+  MPI_Datatype row, column;
+  MPI_Type_contiguous(cols, MPI_CHAR, &row);
+  MPI_Type_commit(&row);
+  MPI_Type_vector(rows, 1, local->stride, MPI_CHAR, &column);
+  MPI_Type_commit(&column);
+  for (int d = 0; d < 9; ++d) {
+    int di = d/3 - 1, dj = d%3 - 1;
+    neighbours[d] = di || dj ? neighbour(grid, dims, coords, di, dj) : MPI_PROC_NULL;
+    types[d] = !di ? column : !dj ? row : MPI_CHAR;
+  }
+  atomic_init(&next_chunk, 0);
+  pool_init(&pool, nthreads);
+  pool_run(&pool, play, NULL);
+  pool_destroy(&pool);
+  if (out_path)
+    save_board(out_path, local, size, steps_left(), mini, minj);
 
-  if (rank > 0){
+  //o caminho inverso: as colunas voltam para a faixa e as faixas para o rank 0
+  if (rank == 0 && !out_path && !board)
     board = allocate_board (size);
-    newboard = allocate_board (size);
-  }
-  //manda as linhas iniciais
-  for (int i = 0; i<size; ++i) {
-    MPI_Bcast(board[i], size, MPI_CHAR, 0, MPI_COMM_WORLD);
-  }
-  if (rank != 0){
-      int i, j;
-      /* for each cell, apply the rules of Life */
-      int maxi = (int)(size/(double)world_size*(process_number+1));
-      int mini = (int)(size/(double)world_size*process_number);
-      //printf("Procesos escravo rank %d mini %d maxi%d:\n",rank, mini, maxi);
-      for (int k=0; k<steps; k++) {
-        //calcula o resto
-        for (i = mini; i<maxi; ++i) {
-          for (j= 0; j<size; j++) {
-            int a = adjacent_to(board, i, j);
-            if (a == 2) {
-              newboard[i][j] = board[i][j];
-            } else if (a == 3) {
-              newboard[i][j] = 1 ;
-            } else {
-              newboard[i][j] = 0;
-            }
-          }
-        }
-        MPI_Status request;
-        // se não for a primeira seção, manda a primeira linha para o proc anterior
-        if (rank > 1) {
-          MPI_Send(newboard[mini], size, MPI_CHAR, rank - 1, k, MPI_COMM_WORLD);
-        }
-        if (rank < world_size){
-          MPI_Recv(newboard[maxi], size, MPI_CHAR, rank+1, k, MPI_COMM_WORLD, &request);
-        }
-        if (rank < world_size){
-          MPI_Send(newboard[maxi-1], size, MPI_CHAR, rank + 1, k, MPI_COMM_WORLD);
-        }
-        if (rank > 1) {
-          MPI_Recv(newboard[mini-1], size, MPI_CHAR, rank-1, k, MPI_COMM_WORLD, &request);
-        }
-        tmp = newboard;
-        newboard = board;
-        board = tmp;
-      }
-      //manda suas linhas para o processo principal
-      for (int i = mini; i<maxi; ++i) {
-        //usando i como tag para receber na ordem certa
-        MPI_Send(board[i], size, MPI_CHAR, 0, i, MPI_COMM_WORLD);
-      }
+  if (out_path) {
+    //cada rank já escreveu o seu bloco
+  } else if (dims[1] > 1) {
+    for (int c = 0; c < dims[1]; ++c) {
+      int lo, hi;
+      split(size, dims[1], c, &lo, &hi);
+      counts[c] = hi - lo;
+      displs[c] = lo;
+    }
+    MPI_Gatherv(board_row(local, 0), cols, local_column,
+                slab ? board_row(slab, 0) : NULL, counts, displs, slab_column, 0, grid_row);
   } else {
-    //recebe os valores finais dos processos
-    for (int i = 0; i<size; ++i) {
-      MPI_Recv(board[i], size, MPI_CHAR, MPI_ANY_SOURCE, i, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    slab = local;
+  }
+  if (!out_path && coords[1] == 0) {
+    for (int r = 0; r < dims[0]; ++r) {
+      int lo, hi;
+      split(size, dims[0], r, &lo, &hi);
+      counts[r] = hi - lo;
+      displs[r] = lo;
     }
+    MPI_Gatherv(board_row(slab, 0), rows, full_row,
+                rank == 0 ? board_row(board, 0) : NULL, counts, displs, full_row, 0, grid_column);
+  }
+  if (rank == 0 && !out_path){
       #ifdef RESULT
-        printf("Final:\n");
-        //print (board,size);
+        output_title("Final:\n");
+        print (board);
       #endif
   }
+  if (board)
+    free_board(board);
+  if (dims[1] > 1 && slab)
+    free_board(slab);
+  free_board(local);
+  free_board(newlocal);
+  free(counts);
+  free(displs);
+  MPI_Type_free(&row);
+  MPI_Type_free(&column);
+  MPI_Type_free(&full_row);
+  MPI_Type_free(&slab_column);
+  MPI_Type_free(&local_column);
+  MPI_Comm_free(&grid_row);
+  MPI_Comm_free(&grid_column);
+  MPI_Comm_free(&grid);
   MPI_Finalize();
 }
@@ -0,0 +1,340 @@
+/*
+* Traces: every generation of a run in one seekable file.
+*
+* A trace holds the board, one bit per cell, for each generation the engine
+* hands over. Every keyframe generations (and at the first frame) it
+* stores the whole board. In between it stores the XOR with the previous
+* frame, which only has the cells that changed. Each frame is compressed
+* as runs of zero bytes and literal bytes. Deltas are almost all zeros,
+* and so are the sparse parts of a keyframe.
+*
+*   header   trace_header_t
+*   frames   trace_frame_t and its packed bytes, one after the other
+*   index    a trace_key_t (generation, offset) per keyframe
+*   footer   trace_footer_t
+*
+* Integers are native. To read generation g, trace_seek finds the last
+* keyframe at or before g in the index and applies the deltas after it.
+* Going forward from the frame it is at, it only applies the new deltas. A
+* trace without a footer (the run was killed) is read by walking the
+* frames.
+*
+*/
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define TRACE_MAGIC 0x544c4f47        /* "GOLT" */
+#define TRACE_INDEX_MAGIC 0x58444e49  /* "INDX" */
+#define TRACE_MIN_ZEROS 8             /* shorter zero runs stay literal */
+
+enum { TRACE_KEY, TRACE_DELTA };
+
+typedef struct {
+  uint32_t magic, size, keyframe, words;  /* words per row */
+  int64_t steps;
+} trace_header_t;
+
+typedef struct {
+  uint32_t kind, bytes;
+  int64_t generation;
+} trace_frame_t;
+
+typedef struct {
+  int64_t generation, offset;
+} trace_key_t;
+
+typedef struct {
+  int64_t index, keys;  /* offset and length of the index */
+  uint32_t magic, pad;
+} trace_footer_t;
+
+static inline size_t trace_put_count (unsigned char * out, size_t n) {
+  size_t o = 0;
+  for (; n >= 0x80; n >>= 7)
+    out[o++] = (n & 0x7f) | 0x80;
+  out[o++] = n;
+  return o;
+}
+
+static inline size_t trace_get_count (const unsigned char * in, size_t * n) {
+  size_t i = 0;
+  int shift = 0;
+  *n = 0;
+  do
+    *n |= (size_t)(in[i] & 0x7f) << shift, shift += 7;
+  while (in[i++] & 0x80);
+  return i;
+}
+
+/* packs n bytes as (zeros, literals, the literal bytes) tokens; out must hold
+ * trace_bound(n) bytes */
+static inline size_t trace_bound (size_t n) {
+  return n + n / TRACE_MIN_ZEROS * 2 + 32;
+}
+
+static inline size_t trace_pack (const unsigned char * in, size_t n, unsigned char * out) {
+  size_t i = 0, o = 0;
+  while (i < n) {
+    size_t zeros = i, end, z;
+    uint64_t w;
+    /* the zero run, a word at a time */
+    while (zeros + 8 <= n && (memcpy(&w, in + zeros, 8), !w))
+      zeros += 8;
+    while (zeros < n && !in[zeros])
+      zeros++;
+    /* the literals, up to the next long zero run */
+    for (end = zeros; end < n; ) {
+      if (in[end]) {
+        end++;
+        continue;
+      }
+      for (z = end; z < n && z - end < TRACE_MIN_ZEROS && !in[z]; z++)
+        ;
+      if (z - end == TRACE_MIN_ZEROS || z == n)
+        break;
+      end = z;
+    }
+    o += trace_put_count(out + o, zeros - i);
+    o += trace_put_count(out + o, end - zeros);
+    memcpy(out + o, in + zeros, end - zeros);
+    o += end - zeros;
+    i = end;
+  }
+  return o;
+}
+
+/* XORs the packed bytes into out, which holds n bytes; a keyframe unpacks
+ * onto zeros */
+static inline int trace_unpack (const unsigned char * in, size_t bytes, unsigned char * out,
+                                size_t n) {
+  size_t i = 0, o = 0, zeros, literals, k;
+  while (i < bytes) {
+    i += trace_get_count(in + i, &zeros);
+    i += trace_get_count(in + i, &literals);
+    o += zeros;
+    if (o + literals > n || i + literals > bytes)
+      return -1;
+    for (k = 0; k < literals; k++)
+      out[o + k] ^= in[i + k];
+    o += literals;
+    i += literals;
+  }
+  return o <= n ? 0 : -1;
+}
+
+/* ------------------------------------------------------------------------- */
+
+typedef struct {
+  FILE * f;
+  int size, words;
+  long long keyframe, last_key;
+  size_t bytes;           /* of a frame, unpacked */
+  uint64_t * previous, * delta;
+  unsigned char * packed;
+  trace_key_t * keys;
+  size_t count, capacity;
+  long long frames;
+} trace_writer_t;
+
+/* a trace of a size x size board with rows of words words; NULL if the file
+ * can not be created */
+static inline trace_writer_t * trace_create (const char * path, int size, int words,
+                                             long long steps, long long keyframe) {
+  trace_header_t header = {TRACE_MAGIC, (uint32_t)size, (uint32_t)keyframe, (uint32_t)words, steps};
+  trace_writer_t * t;
+  FILE * f = fopen(path, "wb");
+  if (!f) {
+    perror(path);
+    return NULL;
+  }
+  fwrite(&header, sizeof(header), 1, f);
+  t = (trace_writer_t *) calloc(1, sizeof(trace_writer_t));
+  t->f = f;
+  t->size = size;
+  t->words = words;
+  t->keyframe = keyframe;
+  t->bytes = (size_t)size * words * sizeof(uint64_t);
+  t->previous = (uint64_t *) calloc((size_t)size * words, sizeof(uint64_t));
+  t->delta = (uint64_t *) malloc(t->bytes);
+  t->packed = (unsigned char *) malloc(trace_bound(t->bytes));
+  return t;
+}
+
+/* appends the board at this generation, rows of t->words words */
+static inline void trace_frame (trace_writer_t * t, const uint64_t * cells, long long generation) {
+  trace_frame_t frame;
+  size_t k, n = (size_t)t->size * t->words;
+  int key = !t->frames || generation >= t->last_key + t->keyframe;
+  const uint64_t * source = cells;
+  if (!key) {
+    for (k = 0; k < n; k++)
+      t->delta[k] = cells[k] ^ t->previous[k];
+    source = t->delta;
+  } else {
+    if (t->count == t->capacity) {
+      t->capacity = t->capacity ? 2 * t->capacity : 64;
+      t->keys = (trace_key_t *) realloc(t->keys, t->capacity * sizeof(trace_key_t));
+    }
+    t->keys[t->count].generation = generation;
+    t->keys[t->count++].offset = ftello(t->f);
+    t->last_key = generation;
+  }
+  frame.kind = key ? TRACE_KEY : TRACE_DELTA;
+  frame.bytes = trace_pack((const unsigned char *)source, t->bytes, t->packed);
+  frame.generation = generation;
+  fwrite(&frame, sizeof(frame), 1, t->f);
+  fwrite(t->packed, 1, frame.bytes, t->f);
+  memcpy(t->previous, cells, t->bytes);
+  t->frames++;
+}
+
+/* writes the index and closes the trace */
+static inline void trace_close (trace_writer_t * t) {
+  trace_footer_t footer = {ftello(t->f), (int64_t)t->count, TRACE_INDEX_MAGIC, 0};
+  fwrite(t->keys, sizeof(trace_key_t), t->count, t->f);
+  fwrite(&footer, sizeof(footer), 1, t->f);
+  if (fclose(t->f))
+    perror("trace");
+  free(t->previous);
+  free(t->delta);
+  free(t->packed);
+  free(t->keys);
+  free(t);
+}
+
+/* ------------------------------------------------------------------------- */
+
+typedef struct {
+  FILE * f;
+  trace_header_t header;
+  size_t bytes;
+  uint64_t * cells;       /* the board at generation */
+  long long generation;   /* -1 before the first seek */
+  int64_t next;           /* offset of the frame after it */
+  trace_key_t * keys;
+  size_t count;
+  int64_t end;            /* where the frames end */
+  unsigned char * packed;
+  size_t packed_capacity;
+} trace_reader_t;
+
+/* reads the header and the index; returns -1 after printing an error */
+static inline int trace_open (FILE * f, trace_reader_t * r) {
+  trace_footer_t footer;
+  trace_frame_t frame;
+  int64_t offset, length;
+  size_t capacity = 0;
+  memset(r, 0, sizeof(*r));
+  r->f = f;
+  r->generation = -1;
+  if (fread(&r->header, sizeof(r->header), 1, f) != 1 || r->header.magic != TRACE_MAGIC) {
+    fprintf(stderr, "not a trace\n");
+    return -1;
+  }
+  r->bytes = (size_t)r->header.size * r->header.words * sizeof(uint64_t);
+  r->cells = (uint64_t *) calloc((size_t)r->header.size * r->header.words, sizeof(uint64_t));
+  fseeko(f, 0, SEEK_END);
+  length = ftello(f);
+  if (length >= (int64_t)(sizeof(r->header) + sizeof(footer))) {
+    fseeko(f, length - sizeof(footer), SEEK_SET);
+    if (fread(&footer, sizeof(footer), 1, f) == 1 && footer.magic == TRACE_INDEX_MAGIC) {
+      r->count = footer.keys;
+      r->keys = (trace_key_t *) malloc((r->count + 1) * sizeof(trace_key_t));
+      fseeko(f, footer.index, SEEK_SET);
+      if (fread(r->keys, sizeof(trace_key_t), r->count, f) == r->count) {
+        r->end = footer.index;
+        return 0;
+      }
+      free(r->keys);
+      r->keys = NULL;
+      r->count = 0;
+    }
+  }
+  /* no index: walk the frames, up to the last complete one */
+  fprintf(stderr, "trace has no index, scanning it\n");
+  for (offset = sizeof(r->header); ; offset += sizeof(frame) + frame.bytes) {
+    fseeko(f, offset, SEEK_SET);
+    if (fread(&frame, sizeof(frame), 1, f) != 1 || offset + (int64_t)sizeof(frame) + frame.bytes > length)
+      break;
+    if (frame.kind != TRACE_KEY)
+      continue;
+    if (r->count == capacity) {
+      capacity = capacity ? 2 * capacity : 64;
+      r->keys = (trace_key_t *) realloc(r->keys, capacity * sizeof(trace_key_t));
+    }
+    r->keys[r->count].generation = frame.generation;
+    r->keys[r->count++].offset = offset;
+  }
+  r->end = offset;
+  return 0;
+}
+
+/* decodes the frame at offset onto r->cells and moves past it */
+static inline int trace_read_frame (trace_reader_t * r, int64_t offset, trace_frame_t * frame) {
+  fseeko(r->f, offset, SEEK_SET);
+  if (fread(frame, sizeof(*frame), 1, r->f) != 1)
+    return -1;
+  if (frame->bytes > r->packed_capacity) {
+    r->packed_capacity = frame->bytes;
+    r->packed = (unsigned char *) realloc(r->packed, r->packed_capacity);
+  }
+  if (fread(r->packed, 1, frame->bytes, r->f) != frame->bytes)
+    return -1;
+  if (frame->kind == TRACE_KEY)
+    memset(r->cells, 0, r->bytes);
+  if (trace_unpack(r->packed, frame->bytes, (unsigned char *)r->cells, r->bytes))
+    return -1;
+  r->generation = frame->generation;
+  r->next = offset + sizeof(*frame) + frame->bytes;
+  return 0;
+}
+
+/* leaves the board of the last frame at or before generation in r->cells
+ * and returns its generation; -1 when the trace starts after it or is
+ * corrupt */
+static inline long long trace_seek (trace_reader_t * r, long long generation) {
+  trace_frame_t frame;
+  size_t lo = 0, hi = r->count;
+  int64_t offset;
+  /* the last keyframe at or before generation */
+  while (hi - lo > 1) {
+    size_t mid = (lo + hi) / 2;
+    if (r->keys[mid].generation <= generation)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  if (!r->count || r->keys[lo].generation > generation)
+    return -1;
+  /* from where the reader is, when that is past the keyframe */
+  if (r->generation >= r->keys[lo].generation && r->generation <= generation) {
+    offset = r->next;
+  } else {
+    offset = r->keys[lo].offset;
+    if (trace_read_frame(r, offset, &frame))
+      return -1;
+    offset = r->next;
+  }
+  while (offset < r->end) {
+    fseeko(r->f, offset, SEEK_SET);
+    if (fread(&frame, sizeof(frame), 1, r->f) != 1 || frame.generation > generation)
+      break;
+    if (trace_read_frame(r, offset, &frame))
+      return -1;
+    offset = r->next;
+  }
+  return r->generation;
+}
+
+static inline void trace_close_reader (trace_reader_t * r) {
+  free(r->cells);
+  free(r->keys);
+  free(r->packed);
+}
+
+#endif
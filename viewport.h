@@ -0,0 +1,173 @@
+/*
+* A zoomable view of a board, drawn from a population pyramid.
+*
+* Level 0 of the pyramid is the board as the renderer last saw it, one byte
+* per cell. Level k counts the live cells of every 2^k x 2^k block. The
+* counts are kept up to date from the tiles that change: the rectangle of
+* a change is copied into level 0, and the blocks over it are summed again
+* from their four children, level by level up to the top, which costs a
+* third more than the copy. (Counts fit in 32 bits since a board has fewer
+* than 2^32 cells.)
+*
+* A view shows the board at a level: at level k >= 0 a screen pixel is one
+* block of level k, shaded by how full the block is. At a negative level a
+* cell is 2^-k pixels wide, and the renderer scales the cells up. Either way
+* the texture holds one texel per visible block, so drawing a zoomed out
+* view of a huge board costs as much as its pixels, not its cells. Only the
+* texels that cover changed tiles are drawn again, unless the view moved.
+*
+*/
+#ifndef VIEWPORT_H
+#define VIEWPORT_H
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+#define VIEW_MIN_LEVEL -4     /* 16 pixels per cell */
+#define VIEW_OUTSIDE 0x25     /* RGB332 dark grey, off the board */
+
+struct pyramid_t {
+  int size, levels;
+  std::vector<unsigned char> cells;               /* level 0 */
+  std::vector<int> sides;                         /* blocks per side */
+  std::vector< std::vector<uint32_t> > counts;    /* levels 1 and up */
+};
+
+static inline void pyramid_init (pyramid_t * p, int size) {
+  int side = size;
+  p->size = size;
+  p->cells.assign((size_t)size * size, 0);
+  p->sides.assign(1, size);
+  p->counts.assign(1, std::vector<uint32_t>());
+  while (side > 1) {
+    side = (side + 1) / 2;
+    p->sides.push_back(side);
+    p->counts.push_back(std::vector<uint32_t>((size_t)side * side, 0));
+  }
+  p->levels = p->sides.size();
+}
+
+/* takes the cells of a rectangle from a frame, one byte per cell */
+static inline void pyramid_update (pyramid_t * p, const unsigned char * pixels,
+                                   int x0, int y0, int w, int h) {
+  int x, y, k, x1 = x0 + w, y1 = y0 + h;
+  for (y = y0; y < y1; y++)
+    memcpy(&p->cells[(size_t)y * p->size + x0], &pixels[(size_t)y * p->size + x0], w);
+  for (k = 1; k < p->levels; k++) {
+    int below = p->sides[k-1], side = p->sides[k];
+    x0 >>= 1, y0 >>= 1, x1 = (x1 + 1) >> 1, y1 = (y1 + 1) >> 1;
+    for (y = y0; y < y1; y++) {
+      uint32_t * block = &p->counts[k][(size_t)y * side];
+      for (x = x0; x < x1; x++) {
+        /* the children past the edge of the level below are empty */
+        int right = 2*x + 1 < below, down = 2*y + 1 < below;
+        if (k == 1) {
+          const unsigned char * a = &p->cells[(size_t)(2*y) * p->size + 2*x];
+          block[x] = (a[0] & 1) + (right ? a[1] & 1 : 0);
+          if (down)
+            block[x] += (a[p->size] & 1) + (right ? a[p->size + 1] & 1 : 0);
+        } else {
+          const uint32_t * a = &p->counts[k-1][(size_t)(2*y) * below + 2*x];
+          block[x] = a[0] + (right ? a[1] : 0);
+          if (down)
+            block[x] += a[below] + (right ? a[below + 1] : 0);
+        }
+      }
+    }
+  }
+}
+
+/* the RGB332 shade of block (bx, by) of level k: black when empty, then
+ * brighter greys as it fills up */
+static inline unsigned char pyramid_shade (const pyramid_t * p, int k, long long bx, long long by) {
+  uint32_t count;
+  int v;
+  if (bx < 0 || by < 0 || bx >= p->sides[k] || by >= p->sides[k])
+    return VIEW_OUTSIDE;
+  if (k == 0)
+    return p->cells[(size_t)by * p->size + bx];
+  count = p->counts[k][(size_t)by * p->sides[k] + bx];
+  if (!count)
+    return 0;
+  v = 1 + (int)(6.0 * count / ((double)(1LL << k) * (1LL << k)) + 0.5);
+  return v << 5 | v << 2 | v >> 1;
+}
+
+struct view_t {
+  int width, height;          /* of the window */
+  int level;
+  long long x, y;             /* the board cell at the top left corner */
+  std::vector<unsigned char> texels;   /* width x height, one per block */
+};
+
+/* the level of the texture: blocks of 2^texel_level cells */
+static inline int view_texel_level (const view_t * v) {
+  return std::max(v->level, 0);
+}
+
+/* texels across and down the window */
+static inline int view_columns (const view_t * v) {
+  return v->level >= 0 ? v->width : (v->width + (1 << -v->level) - 1) >> -v->level;
+}
+
+static inline int view_rows (const view_t * v) {
+  return v->level >= 0 ? v->height : (v->height + (1 << -v->level) - 1) >> -v->level;
+}
+
+/* the block of texel (0, 0) */
+static inline long long view_block (long long cell, int level) {
+  return cell >= 0 ? cell >> level : -((-cell + (1LL << level) - 1) >> level);
+}
+
+/* zooms out so the board fits, centred */
+static inline void view_fit (view_t * v, const pyramid_t * p) {
+  int k = 0;
+  while (k < p->levels - 1 && (((long long)p->size + (1LL << k) - 1) >> k) > std::min(v->width, v->height))
+    k++;
+  v->level = k;
+  v->x = p->size / 2 - ((long long)v->width << k) / 2;
+  v->y = p->size / 2 - ((long long)v->height << k) / 2;
+}
+
+/* zooms by steps levels (in when negative) around the centre of the window */
+static inline void view_zoom (view_t * v, const pyramid_t * p, int steps) {
+  int level = std::min(std::max(v->level + steps, VIEW_MIN_LEVEL), p->levels - 1);
+  long long cx = v->x + (v->level >= 0 ? ((long long)v->width << v->level) : (v->width >> -v->level)) / 2;
+  long long cy = v->y + (v->level >= 0 ? ((long long)v->height << v->level) : (v->height >> -v->level)) / 2;
+  v->level = level;
+  v->x = cx - (level >= 0 ? ((long long)v->width << level) : (v->width >> -level)) / 2;
+  v->y = cy - (level >= 0 ? ((long long)v->height << level) : (v->height >> -level)) / 2;
+}
+
+/* moves by dx, dy pixels */
+static inline void view_pan (view_t * v, int dx, int dy) {
+  v->x += v->level >= 0 ? (long long)dx << v->level : dx >> -v->level;
+  v->y += v->level >= 0 ? (long long)dy << v->level : dy >> -v->level;
+}
+
+/* draws the texels of the view that cover the cell rectangle (all of them
+ * when w is 0) and calls rect(x, y, w, h) with the texels drawn; the texels
+ * are v->texels, width to a row */
+template <typename F>
+static inline void view_draw (view_t * v, const pyramid_t * p, long long x, long long y,
+                              long long w, long long h, F rect) {
+  int k = view_texel_level(v), tx, ty, t0x, t0y, t1x, t1y;
+  long long bx = view_block(v->x, k), by = view_block(v->y, k);
+  t0x = 0, t0y = 0, t1x = view_columns(v), t1y = view_rows(v);
+  if (w) {
+    t0x = std::max<long long>(t0x, view_block(x, k) - bx);
+    t0y = std::max<long long>(t0y, view_block(y, k) - by);
+    t1x = std::min<long long>(t1x, view_block(x + w - 1, k) - bx + 1);
+    t1y = std::min<long long>(t1y, view_block(y + h - 1, k) - by + 1);
+    if (t0x >= t1x || t0y >= t1y)
+      return;
+  }
+  for (ty = t0y; ty < t1y; ty++)
+    for (tx = t0x; tx < t1x; tx++)
+      v->texels[(size_t)ty * v->width + tx] = pyramid_shade(p, k, bx + tx, by + ty);
+  rect(t0x, t0y, t1x - t0x, t1y - t0y);
+}
+
+#endif